@@ -0,0 +1,474 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include "ECS/ECS.h"
+
+using namespace ECS;
+
+// Every allocation carries a header with its size so that live heap bytes can be attributed to the world under test.
+std::atomic<size_t> g_Allocated;
+
+static void* Allocate(size_t size, size_t alignment)
+{
+    alignment         = std::max(alignment, alignof(std::max_align_t));
+    std::byte* memory = static_cast<std::byte*>(std::aligned_alloc(alignment, (size + 2 * alignment - 1) / alignment * alignment));
+    if (!memory)
+    {
+        throw std::bad_alloc();
+    }
+    std::byte* res                     = memory + alignment;
+    reinterpret_cast<size_t*>(res)[-1] = size;
+    reinterpret_cast<size_t*>(res)[-2] = alignment;
+    g_Allocated.fetch_add(size, std::memory_order_relaxed);
+    return res;
+}
+static void Deallocate(void* ptr)
+{
+    if (ptr)
+    {
+        size_t alignment = static_cast<size_t*>(ptr)[-2];
+        g_Allocated.fetch_sub(static_cast<size_t*>(ptr)[-1], std::memory_order_relaxed);
+        std::free(static_cast<std::byte*>(ptr) - alignment);
+    }
+}
+
+void* operator new(size_t size) { return Allocate(size, alignof(std::max_align_t)); }
+void* operator new[](size_t size) { return Allocate(size, alignof(std::max_align_t)); }
+void* operator new(size_t size, std::align_val_t alignment) { return Allocate(size, size_t(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return Allocate(size, size_t(alignment)); }
+void  operator delete(void* ptr) noexcept { Deallocate(ptr); }
+void  operator delete[](void* ptr) noexcept { Deallocate(ptr); }
+void  operator delete(void* ptr, size_t) noexcept { Deallocate(ptr); }
+void  operator delete[](void* ptr, size_t) noexcept { Deallocate(ptr); }
+void  operator delete(void* ptr, std::align_val_t) noexcept { Deallocate(ptr); }
+void  operator delete[](void* ptr, std::align_val_t) noexcept { Deallocate(ptr); }
+void  operator delete(void* ptr, size_t, std::align_val_t) noexcept { Deallocate(ptr); }
+void  operator delete[](void* ptr, size_t, std::align_val_t) noexcept { Deallocate(ptr); }
+
+struct Position
+{
+    float v[4];
+};
+struct Velocity
+{
+    float v[4];
+};
+struct Health
+{
+    float v[4];
+};
+struct Mass
+{
+    float v[4];
+};
+template <int I> struct Tag
+{
+    int v;
+};
+struct Marker
+{
+};
+
+struct Result
+{
+    const char* Name;
+    const char* Mode;
+    uint32_t    Entities;
+    uint32_t    Variant;
+    double      Ns;
+    double      Bytes;
+};
+
+struct Options
+{
+    uint32_t MaxEntities = 1000000;
+    bool     Csv         = false;
+};
+
+std::vector<Result> g_Results;
+volatile float      g_Sink;
+
+const char* Name(StorageMode mode) { return (mode == StorageMode::Pooled ? "pooled" : "archetype"); }
+
+// Runs func until at least 3 repetitions and 50 ms have passed and returns the best time per entity.
+template <typename Func> double Measure(uint32_t entities, Func&& func)
+{
+    using Clock = std::chrono::steady_clock;
+    double best = 1e300;
+    auto   stop = Clock::now() + std::chrono::milliseconds(50);
+    for (int run = 0; run < 3 || (Clock::now() < stop && run < 1000); ++run)
+    {
+        auto begin = Clock::now();
+        func();
+        best = std::min(best, std::chrono::duration<double, std::nano>(Clock::now() - begin).count());
+    }
+    return best / entities;
+}
+void Record(const char* name, StorageMode mode, uint32_t entities, uint32_t variant, double ns, size_t bytes)
+{
+    g_Results.push_back({name, Name(mode), entities, variant, ns, double(bytes) / entities});
+}
+
+void Churn(StorageMode mode, uint32_t n)
+{
+    Storage storage(mode);
+    size_t  before = g_Allocated;
+    double  ns     = Measure(n,
+                        [&]
+                        {
+                            std::vector<Entity> entities = storage.CreateEntities(n, Position{}, Velocity{});
+                            for (Entity& e : entities)
+                            {
+                                e.Destroy();
+                            }
+                        });
+    Record("churn", mode, n, 0, ns, g_Allocated - before);
+}
+
+// Variant 1 adds and removes an empty type, which is stored as a signature bit only. Variant 2 observes the adds and
+// removes and takes their batches once per run.
+template <typename ComponentType> void AddRemove(StorageMode mode, uint32_t n, uint32_t variant)
+{
+    Storage             storage(mode);
+    std::vector<Entity> entities = storage.CreateEntities(n, Position{});
+    size_t              events   = 0;
+    if (variant == 2)
+    {
+        storage.OnAdd<ComponentType>([&events](std::span<const Entity> batch) { events += batch.size(); });
+        storage.OnRemove<ComponentType>([&events](std::span<const Entity> batch) { events += batch.size(); });
+    }
+    size_t before = g_Allocated;
+    double              ns       = Measure(n,
+                        [&]
+                        {
+                            for (Entity& e : entities)
+                            {
+                                e.Add<ComponentType>();
+                            }
+                            for (Entity& e : entities)
+                            {
+                                e.Remove<ComponentType>();
+                            }
+                            storage.FlushEvents();
+                        });
+    Record("add_remove", mode, n, variant, ns, g_Allocated - before);
+}
+
+void GetRandom(StorageMode mode, uint32_t n)
+{
+    Storage             storage(mode);
+    size_t              before   = g_Allocated;
+    std::vector<Entity> entities = storage.CreateEntities(n, Position{}, Velocity{});
+    size_t              bytes    = g_Allocated - before;
+    std::shuffle(entities.begin(), entities.end(), std::mt19937(42));
+    double ns = Measure(n,
+                        [&]
+                        {
+                            float sum = 0;
+                            for (Entity& e : entities)
+                            {
+                                sum += e.Get<const Velocity>()->v[0];
+                            }
+                            g_Sink = sum;
+                        });
+    Record("get_random", mode, n, 0, ns, bytes);
+}
+
+// Iterates a view over the first components of entities that carry all four.
+template <typename... Components> void Iterate(StorageMode mode, uint32_t n)
+{
+    Storage storage(mode);
+    size_t  before = g_Allocated;
+    storage.CreateEntities(n, Position{}, Velocity{}, Health{}, Mass{});
+    size_t bytes = g_Allocated - before;
+    double ns    = Measure(n,
+                        [&]
+                        {
+                            float sum = 0;
+                            storage.View<const Components...>().Each([&sum](const Components&... components) { sum += (components.v[0] + ...); });
+                            g_Sink = sum;
+                        });
+    Record("iterate", mode, n, sizeof...(Components), ns, bytes);
+}
+
+// Only one in `stride` entities carries the second component.
+void Sparse(StorageMode mode, uint32_t n, uint32_t stride)
+{
+    Storage             storage(mode);
+    size_t              before   = g_Allocated;
+    std::vector<Entity> entities = storage.CreateEntities(n, Position{});
+    for (uint32_t i = 0; i < n; i += stride)
+    {
+        entities[i].Add<Velocity>();
+    }
+    size_t bytes = g_Allocated - before;
+    double ns    = Measure(n,
+                        [&]
+                        {
+                            float sum = 0;
+                            storage.View<const Position, const Velocity>().Each([&sum](const Position& p, const Velocity& v) { sum += p.v[0] + v.v[0]; });
+                            g_Sink = sum;
+                        });
+    Record("sparse", mode, n, stride, ns, bytes);
+}
+
+// Every other entity is marked and skipped. Variant 0 tests the marker per entity with Entity::Has, variant 1 excludes it in the view.
+void Exclude(StorageMode mode, uint32_t n, bool exclude)
+{
+    Storage             storage(mode);
+    std::vector<Entity> entities = storage.CreateEntities(n, Position{}, Velocity{});
+    for (uint32_t i = 0; i < n; i += 2)
+    {
+        entities[i].Add<Marker>();
+    }
+    double ns = Measure(n,
+                        [&]
+                        {
+                            float sum = 0;
+                            if (exclude)
+                            {
+                                storage.View<const Position, const Velocity>().Exclude<Marker>().Each([&sum](const Position& p, const Velocity& v) { sum += p.v[0] + v.v[0]; });
+                            }
+                            else
+                            {
+                                storage.View<const Position, const Velocity>().Each(
+                                    [&sum](Entity e, const Position& p, const Velocity& v)
+                                    {
+                                        if (!e.Has<Marker>())
+                                        {
+                                            sum += p.v[0] + v.v[0];
+                                        }
+                                    });
+                            }
+                            g_Sink = sum;
+                        });
+    Record("exclude", mode, n, exclude, ns, 0);
+}
+
+// Publishes two of four component types into a FrameBuffer for a reader thread, once the frames have grown. Every frame
+// advances the tick and writes the Position of one in `stride` entities first.
+void Publish(StorageMode mode, uint32_t n, uint32_t stride)
+{
+    Storage                         storage(mode);
+    std::vector<Entity>             entities = storage.CreateEntities(n, Position{}, Velocity{}, Health{}, Mass{});
+    FrameBuffer<Position, Velocity> frames(storage);
+    frames.Publish();
+    frames.Publish();
+    size_t before = g_Allocated;
+    double ns     = Measure(n,
+                        [&]
+                        {
+                            storage.AdvanceTick();
+                            for (uint32_t i = 0; i < n; i += stride)
+                            {
+                                entities[i].Get<Position>()->v[0] += 1;
+                            }
+                            frames.Publish();
+                        });
+    Record("publish", mode, n, stride, ns, g_Allocated - before);
+}
+
+// Matching entities are spread over 2^tags archetypes, interleaved in creation order.
+template <int... I> void Fragmented(StorageMode mode, uint32_t n, std::integer_sequence<int, I...>)
+{
+    Storage             storage(mode);
+    size_t              before   = g_Allocated;
+    std::vector<Entity> entities = storage.CreateEntities(n, Position{}, Velocity{});
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        ((i >> I & 1 ? (void)entities[i].Add<Tag<I>>() : void()), ...);
+    }
+    size_t bytes = g_Allocated - before;
+    double ns    = Measure(n,
+                        [&]
+                        {
+                            float sum = 0;
+                            storage.View<const Position, const Velocity>().Each([&sum](const Position& p, const Velocity& v) { sum += p.v[0] + v.v[0]; });
+                            g_Sink = sum;
+                        });
+    Record("fragmented", mode, n, 1 << sizeof...(I), ns, bytes);
+}
+
+// Create and destroy in a storage that knows 120 component types while the entities hold two of them. Variant 1 destroys
+// them through one DestroyAll.
+template <int... I> void Cleanup(StorageMode mode, uint32_t n, bool batch, std::integer_sequence<int, I...>)
+{
+    Storage storage(mode);
+    Entity  wide = storage.CreateEntity();
+    (wide.Add<Tag<I>>(), ...);
+    double ns = Measure(n,
+                        [&]
+                        {
+                            std::vector<Entity> entities = storage.CreateEntities(n, Position{}, Velocity{});
+                            if (batch)
+                            {
+                                storage.DestroyAll<Position>();
+                                return;
+                            }
+                            for (Entity& e : entities)
+                            {
+                                e.Destroy();
+                            }
+                        });
+    Record("cleanup", mode, n, batch, ns, 0);
+}
+
+// Same worlds as iterate (stride 1) and sparse, iterated through an owning group. Pooled storage only.
+void Grouped(StorageMode mode, uint32_t n, uint32_t stride)
+{
+    Storage             storage(mode);
+    size_t              before   = g_Allocated;
+    std::vector<Entity> entities = storage.CreateEntities(n, Position{});
+    for (uint32_t i = 0; i < n; i += stride)
+    {
+        entities[i].Add<Velocity>();
+    }
+    if (!storage.Group<Position, Velocity>())
+    {
+        return;
+    }
+    size_t bytes = g_Allocated - before;
+    double ns    = Measure(n,
+                        [&]
+                        {
+                            float sum = 0;
+                            storage.View<const Position, const Velocity>().Each([&sum](const Position& p, const Velocity& v) { sum += p.v[0] + v.v[0]; });
+                            g_Sink = sum;
+                        });
+    Record("group", mode, n, stride, ns, bytes);
+}
+
+// Propagates positions down a random tree in one pass over a view, variant 1 after SortHierarchy.
+// Every node is created before its parent, so unsorted pools hold children ahead of their parents.
+void Propagate(StorageMode mode, uint32_t n, bool sorted)
+{
+    Storage             storage(mode);
+    std::vector<Entity> entities = storage.CreateEntities(n, Position{});
+    std::mt19937        random(42);
+    for (uint32_t i = 0; i + 1 < n; ++i)
+    {
+        entities[i].SetParent(entities[i + 1 + random() % (n - i - 1)]);
+    }
+    if (sorted)
+    {
+        storage.SortHierarchy<Position>();
+    }
+    size_t before = g_Allocated;
+    double ns     = Measure(n,
+                        [&storage]
+                        {
+                            storage.View<const Hierarchy, Position>().Each(
+                                [](Entity e, const Hierarchy& node, Position& p)
+                                {
+                                    if (node.Parent != EntityManager::Null)
+                                    {
+                                        p.v[1] = p.v[0] + e.Parent().Get<const Position>()->v[1];
+                                    }
+                                });
+                        });
+    Record("propagate", mode, n, sorted, ns, g_Allocated - before);
+}
+
+// Saves a world with two raw columns to a file and loads it into a fresh Storage, teardown included.
+void Snapshot(StorageMode mode, uint32_t n)
+{
+    auto load = [mode]
+    {
+        auto storage = std::make_unique<Storage>(mode);
+        storage->RegisterSnapshot<Position>("Position");
+        storage->RegisterSnapshot<Velocity>("Velocity");
+        storage->LoadSnapshot("benchmark_snapshot.bin");
+        return storage;
+    };
+    Storage storage(mode);
+    storage.RegisterSnapshot<Position>("Position");
+    storage.RegisterSnapshot<Velocity>("Velocity");
+    storage.CreateEntities(n, Position{}, Velocity{});
+    double ns = Measure(n, [&storage] { storage.SaveSnapshot("benchmark_snapshot.bin"); });
+    Record("snapshot_save", mode, n, 0, ns, 0);
+
+    size_t before = g_Allocated;
+    auto   loaded = load();
+    size_t bytes  = g_Allocated - before;
+    loaded.reset();
+    ns = Measure(n, [&load] { load(); });
+    Record("snapshot_load", mode, n, 0, ns, bytes);
+    std::remove("benchmark_snapshot.bin");
+}
+
+void Print(const Options& options)
+{
+    if (options.Csv)
+    {
+        printf("benchmark,mode,entities,variant,ns_per_entity,bytes_per_entity\n");
+        for (const Result& r : g_Results)
+        {
+            printf("%s,%s,%u,%u,%.3f,%.2f\n", r.Name, r.Mode, r.Entities, r.Variant, r.Ns, r.Bytes);
+        }
+        return;
+    }
+    printf("[\n");
+    for (size_t i = 0; i < g_Results.size(); ++i)
+    {
+        const Result& r = g_Results[i];
+        printf("  {\"benchmark\": \"%s\", \"mode\": \"%s\", \"entities\": %u, \"variant\": %u, \"ns_per_entity\": %.3f, \"bytes_per_entity\": %.2f}%s\n",
+               r.Name, r.Mode, r.Entities, r.Variant, r.Ns, r.Bytes, (i + 1 == g_Results.size() ? "" : ","));
+    }
+    printf("]\n");
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--csv"))
+        {
+            options.Csv = true;
+        }
+        else if (!strcmp(argv[i], "--max") && i + 1 < argc)
+        {
+            options.MaxEntities = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--csv] [--max ENTITIES]\n", argv[0]);
+            return 1;
+        }
+    }
+    for (StorageMode mode : {StorageMode::Pooled, StorageMode::Archetype})
+    {
+        for (uint32_t n = 1000; n <= options.MaxEntities; n *= 10)
+        {
+            Churn(mode, n);
+            AddRemove<Velocity>(mode, n, 0);
+            AddRemove<Marker>(mode, n, 1);
+            AddRemove<Velocity>(mode, n, 2);
+            GetRandom(mode, n);
+            Iterate<Position>(mode, n);
+            Iterate<Position, Velocity>(mode, n);
+            Iterate<Position, Velocity, Health>(mode, n);
+            Iterate<Position, Velocity, Health, Mass>(mode, n);
+            Sparse(mode, n, 10);
+            Sparse(mode, n, 100);
+            Exclude(mode, n, false);
+            Exclude(mode, n, true);
+            Grouped(mode, n, 1);
+            Grouped(mode, n, 10);
+            Grouped(mode, n, 100);
+            Fragmented(mode, n, std::make_integer_sequence<int, 3>());
+            Cleanup(mode, n, false, std::make_integer_sequence<int, 118>());
+            Cleanup(mode, n, true, std::make_integer_sequence<int, 118>());
+            Snapshot(mode, n);
+            Publish(mode, n, 1);
+            Publish(mode, n, 100);
+            Propagate(mode, n, false);
+            Propagate(mode, n, true);
+            fprintf(stderr, "%s %u done\n", Name(mode), n);
+        }
+    }
+    Print(options);
+    return 0;
+}
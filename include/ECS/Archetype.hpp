@@ -0,0 +1,395 @@
+#pragma once
+
+namespace ECS
+{
+
+    template <typename ComponentType> ComponentInfo ComponentInfo::Create()
+    {
+        ComponentInfo info;
+        info.Size          = (IsTag<ComponentType> ? 0 : sizeof(ComponentType));
+        info.Alignment     = alignof(ComponentType);
+        info.MoveConstruct = [](void* dst, void* src) { new (dst) ComponentType(std::move(*reinterpret_cast<ComponentType*>(src))); };
+        info.Destruct      = [](void* ptr) { reinterpret_cast<ComponentType*>(ptr)->~ComponentType(); };
+        return info;
+    }
+
+    //*___ARCHETYPE___________________________________________________________________________________________________________________________________________________________________________________________
+
+    Archetype::Archetype(const Signature& signature, const std::vector<std::pair<uint32_t, ComponentInfo>>& columns, std::pmr::memory_resource* resource) :
+        m_Signature(signature), m_Chunks(resource), m_Entities(resource)
+    {
+        size_t row_bytes   = 0;
+        m_ChunkAlignment   = 64;
+        m_MaxComponentSize = 0;
+        for (const auto& [component_id, info] : columns)
+        {
+            if (m_ColumnIndex.size() <= component_id)
+            {
+                m_ColumnIndex.resize(component_id + 1, -1);
+            }
+            m_ColumnIndex[component_id] = m_Columns.size();
+            m_Columns.push_back({component_id, info, 0, 0});
+            m_ChunkAlignment   = std::max(m_ChunkAlignment, info.Alignment);
+            m_MaxComponentSize = std::max(m_MaxComponentSize, info.Size);
+            row_bytes += info.Size + sizeof(ComponentTicks);
+        }
+        m_ChunkCapacity = std::max<size_t>(1, ChunkSize / std::max<size_t>(1, row_bytes));
+        while (m_ChunkCapacity > 1 && Layout(m_ChunkCapacity) > ChunkSize)
+        {
+            --m_ChunkCapacity;
+        }
+        m_ChunkBytes = std::max(ChunkSize, Layout(m_ChunkCapacity));
+    }
+    Archetype::~Archetype()
+    {
+        while (!m_Entities.empty())
+        {
+            Erase(m_Entities.size() - 1);
+        }
+        for (std::byte* chunk : m_Chunks)
+        {
+            m_Chunks.get_allocator().resource()->deallocate(chunk, m_ChunkBytes, m_ChunkAlignment);
+        }
+    }
+
+    uint32_t                          Archetype::Size() const { return m_Entities.size(); }
+    uint32_t                          Archetype::ChunkCapacity() const { return m_ChunkCapacity; }
+    const Signature&                  Archetype::GetSignature() const { return m_Signature; }
+    const std::pmr::vector<uint32_t>& Archetype::Entities() const { return m_Entities; }
+    int32_t                           Archetype::ColumnIndex(uint32_t component_id) const
+    {
+        return (component_id < m_ColumnIndex.size() ? m_ColumnIndex[component_id] : -1);
+    }
+    void* Archetype::At(int32_t column, uint32_t row)
+    {
+        const Column& col = m_Columns[column];
+        return m_Chunks[row / m_ChunkCapacity] + col.Offset + (row % m_ChunkCapacity) * col.Info.Size;
+    }
+    ComponentTicks* Archetype::TicksAt(int32_t column, uint32_t row)
+    {
+        return reinterpret_cast<ComponentTicks*>(m_Chunks[row / m_ChunkCapacity] + m_Columns[column].TickOffset) + row % m_ChunkCapacity;
+    }
+
+    uint32_t Archetype::Allocate(uint32_t entity_id)
+    {
+        if (m_Entities.size() == m_Chunks.size() * m_ChunkCapacity)
+        {
+            m_Chunks.push_back(static_cast<std::byte*>(m_Chunks.get_allocator().resource()->allocate(m_ChunkBytes, m_ChunkAlignment)));
+        }
+        m_Entities.push_back(entity_id);
+        return m_Entities.size() - 1;
+    }
+    uint32_t Archetype::Erase(uint32_t row)
+    {
+        uint32_t last  = m_Entities.size() - 1;
+        uint32_t moved = None;
+        for (size_t column = 0; column < m_Columns.size(); ++column)
+        {
+            const ComponentInfo& info = m_Columns[column].Info;
+            info.Destruct(At(column, row));
+            if (row != last)
+            {
+                info.MoveConstruct(At(column, row), At(column, last));
+                info.Destruct(At(column, last));
+                *TicksAt(column, row) = *TicksAt(column, last);
+            }
+        }
+        if (row != last)
+        {
+            moved           = m_Entities[last];
+            m_Entities[row] = moved;
+        }
+        m_Entities.pop_back();
+        if (m_Chunks.size() > 1 && m_Entities.size() <= (m_Chunks.size() - 2) * m_ChunkCapacity)
+        {
+            m_Chunks.get_allocator().resource()->deallocate(m_Chunks.back(), m_ChunkBytes, m_ChunkAlignment);
+            m_Chunks.pop_back();
+        }
+        return moved;
+    }
+    // scratch holds one component of any column while the two rows trade places.
+    void Archetype::Swap(uint32_t a, uint32_t b, std::byte* scratch)
+    {
+        for (size_t column = 0; column < m_Columns.size(); ++column)
+        {
+            const ComponentInfo& info = m_Columns[column].Info;
+            info.MoveConstruct(scratch, At(column, a));
+            info.Destruct(At(column, a));
+            info.MoveConstruct(At(column, a), At(column, b));
+            info.Destruct(At(column, b));
+            info.MoveConstruct(At(column, b), scratch);
+            info.Destruct(scratch);
+            std::swap(*TicksAt(column, a), *TicksAt(column, b));
+        }
+        std::swap(m_Entities[a], m_Entities[b]);
+    }
+    size_t Archetype::Layout(uint32_t capacity)
+    {
+        size_t offset = 0;
+        for (auto& column : m_Columns)
+        {
+            offset        = (offset + column.Info.Alignment - 1) / column.Info.Alignment * column.Info.Alignment;
+            column.Offset = offset;
+            offset += column.Info.Size * capacity;
+        }
+        // Ticks sit after all component arrays so that iteration without filters never pulls them into cache.
+        for (auto& column : m_Columns)
+        {
+            offset            = (offset + alignof(ComponentTicks) - 1) / alignof(ComponentTicks) * alignof(ComponentTicks);
+            column.TickOffset = offset;
+            offset += sizeof(ComponentTicks) * capacity;
+        }
+        return offset;
+    }
+
+    //*___ARCHETYPE_MANAGER___________________________________________________________________________________________________________________________________________________________________________________________
+
+    ArchetypeManager::ArchetypeManager(std::pmr::memory_resource* resource) : m_Locations(resource) {}
+
+    void ArchetypeManager::RegisterComponent(uint32_t component_id, const ComponentInfo& info)
+    {
+        if (m_ComponentInfos.size() <= component_id)
+        {
+            m_ComponentInfos.resize(component_id + 1);
+        }
+        m_ComponentInfos[component_id] = info;
+    }
+    template <typename ComponentType, typename... Args>
+    ComponentType* ArchetypeManager::Emplace(uint32_t entity_id, uint32_t component_id, uint32_t tick, Args&&... args)
+    {
+        ValidateLocation(entity_id);
+        Location location = m_Locations[entity_id];
+        if constexpr (IsTag<ComponentType>)
+        {
+            if (location.ArchetypeIndex == Archetype::None || !m_Archetypes[location.ArchetypeIndex]->GetSignature().Get(component_id))
+            {
+                Move(entity_id, AddEdge(location.ArchetypeIndex, component_id));
+            }
+            return TagInstance<ComponentType>();
+        }
+        if (location.ArchetypeIndex != Archetype::None)
+        {
+            int32_t column = m_Archetypes[location.ArchetypeIndex]->ColumnIndex(component_id);
+            if (column != -1)
+            {
+                auto* res = reinterpret_cast<ComponentType*>(m_Archetypes[location.ArchetypeIndex]->At(column, location.Row));
+                ComponentArray<ComponentType>::Assign(*res, std::forward<Args>(args)...);
+                m_Archetypes[location.ArchetypeIndex]->TicksAt(column, location.Row)->Changed = tick;
+                return res;
+            }
+        }
+        uint32_t   target    = AddEdge(location.ArchetypeIndex, component_id);
+        uint32_t   row       = Move(entity_id, target);
+        Archetype& archetype = *m_Archetypes[target];
+        int32_t    column    = archetype.ColumnIndex(component_id);
+        *archetype.TicksAt(column, row) = {tick, tick};
+        return new (archetype.At(column, row)) ComponentType(std::forward<Args>(args)...);
+    }
+    void* ArchetypeManager::GetComponent(uint32_t entity_id, uint32_t component_id)
+    {
+        const Location& location  = m_Locations[entity_id];
+        Archetype&      archetype = *m_Archetypes[location.ArchetypeIndex];
+        return archetype.At(archetype.ColumnIndex(component_id), location.Row);
+    }
+    ComponentTicks* ArchetypeManager::GetTicks(uint32_t entity_id, uint32_t component_id)
+    {
+        const Location& location  = m_Locations[entity_id];
+        Archetype&      archetype = *m_Archetypes[location.ArchetypeIndex];
+        int32_t         column    = archetype.ColumnIndex(component_id);
+        return (column == -1 ? nullptr : archetype.TicksAt(column, location.Row));
+    }
+    void ArchetypeManager::RemoveComponent(uint32_t entity_id, uint32_t component_id)
+    {
+        Move(entity_id, RemoveEdge(m_Locations[entity_id].ArchetypeIndex, component_id));
+    }
+    void ArchetypeManager::Destroy(uint32_t entity_id)
+    {
+        if (entity_id < m_Locations.size() && m_Locations[entity_id].ArchetypeIndex != Archetype::None)
+        {
+            Move(entity_id, Archetype::None);
+        }
+    }
+
+    // Places fresh entities straight into the archetype of their final signature instead of moving them once per component.
+    template <typename... Components>
+    void ArchetypeManager::Spawn(const std::vector<uint32_t>& ids, const Signature& signature, uint32_t tick, const Components&... components)
+    {
+        if (ids.empty())
+        {
+            return;
+        }
+        ValidateLocation(*std::max_element(ids.begin(), ids.end()));
+        uint32_t                                      target    = FindOrCreate(signature);
+        Archetype&                                    archetype = *m_Archetypes[target];
+        std::array<int32_t, sizeof...(Components)> columns{archetype.ColumnIndex(ComponentTypeId::Get<Components>())...};
+        auto place = [&archetype, tick](const auto& component, int32_t column, uint32_t row)
+        {
+            using ComponentType = std::decay_t<decltype(component)>;
+            if constexpr (!IsTag<ComponentType>)
+            {
+                new (archetype.At(column, row)) ComponentType(component);
+                *archetype.TicksAt(column, row) = {tick, tick};
+            }
+        };
+        for (uint32_t id : ids)
+        {
+            uint32_t row = archetype.Allocate(id);
+            size_t   i   = 0;
+            (place(components, columns[i++], row), ...);
+            m_Locations[id] = {target, row};
+        }
+    }
+    void ArchetypeManager::Place(uint32_t entity_id, const Signature& signature)
+    {
+        ValidateLocation(entity_id);
+        uint32_t target        = FindOrCreate(signature);
+        m_Locations[entity_id] = {target, m_Archetypes[target]->Allocate(entity_id)};
+    }
+
+    template <typename ComponentType, typename Compare> void ArchetypeManager::Sort(uint32_t component_id, Compare& compare)
+    {
+        std::pmr::memory_resource* resource = m_Locations.get_allocator().resource();
+        for (const auto& archetype : m_Archetypes)
+        {
+            int32_t column = archetype->ColumnIndex(component_id);
+            if (column == -1 || archetype->Size() < 2)
+            {
+                continue;
+            }
+            std::vector<uint32_t> order(archetype->Size());
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(),
+                      [&](uint32_t a, uint32_t b)
+                      { return compare(*reinterpret_cast<ComponentType*>(archetype->At(column, a)), *reinterpret_cast<ComponentType*>(archetype->At(column, b))); });
+            for (uint32_t& row : order)
+            {
+                row = archetype->Entities()[row];
+            }
+            // Row i holds order[i] once step i is done, as in IComponentArray::Reorder.
+            std::byte* scratch = static_cast<std::byte*>(resource->allocate(archetype->m_MaxComponentSize, archetype->m_ChunkAlignment));
+            for (uint32_t row = 0; row < order.size(); ++row)
+            {
+                uint32_t current = m_Locations[order[row]].Row;
+                if (current != row)
+                {
+                    archetype->Swap(row, current, scratch);
+                    m_Locations[archetype->Entities()[row]].Row     = row;
+                    m_Locations[archetype->Entities()[current]].Row = current;
+                }
+            }
+            resource->deallocate(scratch, archetype->m_MaxComponentSize, archetype->m_ChunkAlignment);
+        }
+    }
+
+    std::vector<Archetype*> ArchetypeManager::Matching(const Signature& signature) const
+    {
+        std::vector<Archetype*> res;
+        for (const auto& archetype : m_Archetypes)
+        {
+            if (archetype->Size() != 0 && archetype->GetSignature().Matches(signature))
+            {
+                res.push_back(archetype.get());
+            }
+        }
+        return res;
+    }
+
+    uint32_t ArchetypeManager::FindOrCreate(const Signature& signature)
+    {
+        auto it = m_ArchetypeIndex.find(signature);
+        if (it != m_ArchetypeIndex.end())
+        {
+            return it->second;
+        }
+        std::vector<std::pair<uint32_t, ComponentInfo>> columns;
+        for (uint32_t component_id = 0; component_id < m_ComponentInfos.size(); ++component_id)
+        {
+            // Tags are part of the signature but get no column.
+            if (signature.Get(component_id) && m_ComponentInfos[component_id].Size != 0)
+            {
+                columns.emplace_back(component_id, m_ComponentInfos[component_id]);
+            }
+        }
+        uint32_t index = m_Archetypes.size();
+        m_Archetypes.push_back(std::make_unique<Archetype>(signature, columns, m_Locations.get_allocator().resource()));
+        m_ArchetypeIndex[signature] = index;
+        return index;
+    }
+    uint32_t ArchetypeManager::AddEdge(uint32_t archetype, uint32_t component_id)
+    {
+        if (archetype == Archetype::None)
+        {
+            Signature signature;
+            signature.Set(component_id, true);
+            return FindOrCreate(signature);
+        }
+        auto& edges = m_Archetypes[archetype]->m_AddEdges;
+        if (edges.size() <= component_id)
+        {
+            edges.resize(component_id + 1, Archetype::None);
+        }
+        if (edges[component_id] == Archetype::None)
+        {
+            Signature signature = m_Archetypes[archetype]->GetSignature();
+            signature.Set(component_id, true);
+            edges[component_id] = FindOrCreate(signature);
+        }
+        return edges[component_id];
+    }
+    uint32_t ArchetypeManager::RemoveEdge(uint32_t archetype, uint32_t component_id)
+    {
+        auto& edges = m_Archetypes[archetype]->m_RemoveEdges;
+        if (edges.size() <= component_id)
+        {
+            edges.resize(component_id + 1, Archetype::None);
+        }
+        if (edges[component_id] == Archetype::None)
+        {
+            Signature signature = m_Archetypes[archetype]->GetSignature();
+            signature.Set(component_id, false);
+            edges[component_id] = (signature.Size() == 0 ? Archetype::None : FindOrCreate(signature));
+        }
+        return edges[component_id];
+    }
+    uint32_t ArchetypeManager::Move(uint32_t entity_id, uint32_t target)
+    {
+        Location location = m_Locations[entity_id];
+        uint32_t row      = 0;
+        if (target != Archetype::None)
+        {
+            Archetype& dst = *m_Archetypes[target];
+            row            = dst.Allocate(entity_id);
+            if (location.ArchetypeIndex != Archetype::None)
+            {
+                Archetype& src = *m_Archetypes[location.ArchetypeIndex];
+                for (size_t column = 0; column < dst.m_Columns.size(); ++column)
+                {
+                    int32_t src_column = src.ColumnIndex(dst.m_Columns[column].ComponentId);
+                    if (src_column != -1)
+                    {
+                        dst.m_Columns[column].Info.MoveConstruct(dst.At(column, row), src.At(src_column, location.Row));
+                        *dst.TicksAt(column, row) = *src.TicksAt(src_column, location.Row);
+                    }
+                }
+            }
+        }
+        if (location.ArchetypeIndex != Archetype::None)
+        {
+            uint32_t moved = m_Archetypes[location.ArchetypeIndex]->Erase(location.Row);
+            if (moved != Archetype::None)
+            {
+                m_Locations[moved].Row = location.Row;
+            }
+        }
+        m_Locations[entity_id] = {target, row};
+        return row;
+    }
+    void ArchetypeManager::ValidateLocation(uint32_t entity_id)
+    {
+        if (m_Locations.size() <= entity_id)
+        {
+            m_Locations.resize(entity_id + 1);
+        }
+    }
+
+}  // namespace ECS
@@ -0,0 +1,104 @@
+#pragma once
+
+namespace ECS
+{
+
+    Entity CommandBuffer::Create()
+    {
+        Entity res;
+        res.m_ID  = m_Creates++;
+        res.m_Gen = Placeholder;
+        ++m_Commands;
+        Profiler::CountChanges(1);
+        return res;
+    }
+    template <typename ComponentType> void CommandBuffer::Add(const Entity& entity, ComponentType component)
+    {
+        GetBucket<ComponentType>().m_Adds.emplace_back(Target{entity.m_ID, entity.m_Gen}, std::move(component));
+        ++m_Commands;
+        Profiler::CountChanges(1);
+    }
+    template <typename ComponentType> void CommandBuffer::Remove(const Entity& entity)
+    {
+        GetBucket<ComponentType>().m_Removes.push_back({entity.m_ID, entity.m_Gen});
+        ++m_Commands;
+        Profiler::CountChanges(1);
+    }
+    void CommandBuffer::Destroy(const Entity& entity)
+    {
+        m_Destroys.push_back({entity.m_ID, entity.m_Gen});
+        ++m_Commands;
+        Profiler::CountChanges(1);
+    }
+
+    bool CommandBuffer::Empty() const { return m_Commands == 0; }
+    void CommandBuffer::Clear()
+    {
+        for (auto& bucket : m_Buckets)
+        {
+            if (bucket)
+            {
+                bucket->Clear();
+            }
+        }
+        m_Destroys.clear();
+        m_Creates  = 0;
+        m_Commands = 0;
+    }
+
+    void CommandBuffer::Resolve(Target& target, const Created& created)
+    {
+        if (target.Gen == Placeholder)
+        {
+            // Generation 0 is never valid, so placeholders of other buffers are dropped.
+            target = (target.ID < created.size() ? Target{created[target.ID].first, created[target.ID].second} : Target{0, 0});
+        }
+    }
+    template <typename ComponentType> CommandBuffer::Bucket<ComponentType>& CommandBuffer::GetBucket()
+    {
+        const uint32_t component_id = ComponentTypeId::Get<ComponentType>();
+        if (m_Buckets.size() <= component_id)
+        {
+            m_Buckets.resize(component_id + 1);
+        }
+        if (!m_Buckets[component_id])
+        {
+            m_Buckets[component_id] = std::make_unique<Bucket<ComponentType>>();
+        }
+        return *static_cast<Bucket<ComponentType>*>(m_Buckets[component_id].get());
+    }
+
+    template <typename ComponentType> uint32_t CommandBuffer::Bucket<ComponentType>::Adds() const { return m_Adds.size(); }
+    template <typename ComponentType> void     CommandBuffer::Bucket<ComponentType>::Reserve(Storage& storage, uint32_t count)
+    {
+        storage.m_ComponentManager.Reserve<ComponentType>(count);
+    }
+    template <typename ComponentType> void CommandBuffer::Bucket<ComponentType>::Playback(Storage& storage, const Created& created)
+    {
+        auto by_entity = [](const auto& lhs, const auto& rhs) { return lhs.ID < rhs.ID; };
+        for (auto& [target, component] : m_Adds)
+        {
+            Resolve(target, created);
+        }
+        std::stable_sort(m_Adds.begin(), m_Adds.end(), [&by_entity](const auto& lhs, const auto& rhs) { return by_entity(lhs.first, rhs.first); });
+        for (auto& [target, component] : m_Adds)
+        {
+            storage.EmplaceComponent<ComponentType>(target.ID, target.Gen, std::move(component));
+        }
+        for (auto& target : m_Removes)
+        {
+            Resolve(target, created);
+        }
+        std::stable_sort(m_Removes.begin(), m_Removes.end(), by_entity);
+        for (const auto& target : m_Removes)
+        {
+            storage.RemoveComponent<ComponentType>(target.ID, target.Gen);
+        }
+    }
+    template <typename ComponentType> void CommandBuffer::Bucket<ComponentType>::Clear()
+    {
+        m_Adds.clear();
+        m_Removes.clear();
+    }
+
+}  // namespace ECS
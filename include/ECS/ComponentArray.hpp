@@ -3,30 +3,342 @@
 namespace ECS
 {
 
-    template <typename ComponentType> void* ComponentArray<ComponentType>::AddComponent(uint32_t id, void* component)
+    SparseSet::SparseSet(std::pmr::memory_resource* resource) : m_Sparse(resource), m_Dense(resource) {}
+    SparseSet::~SparseSet()
     {
-        if (m_ComponentArray.size() < id + 1)
+        for (uint32_t* page : m_Sparse)
         {
-            m_EntityToIndex[id] = m_ComponentArray.size();
-            m_ComponentArray.push_back(*reinterpret_cast<ComponentType*>(component));
+            if (page)
+            {
+                Resource()->deallocate(page, PageSize * sizeof(uint32_t), alignof(uint32_t));
+            }
+        }
+    }
+
+    bool     SparseSet::Contains(uint32_t id) const { return Index(id) != None; }
+    uint32_t SparseSet::Index(uint32_t id) const
+    {
+        if (m_Sparse.size() <= id / PageSize || !m_Sparse[id / PageSize])
+        {
+            return None;
+        }
+        return m_Sparse[id / PageSize][id % PageSize];
+    }
+    uint32_t                          SparseSet::Size() const { return m_Dense.size(); }
+    uint64_t                          SparseSet::Version() const { return m_Version; }
+    const std::pmr::vector<uint32_t>& SparseSet::Entities() const { return m_Dense; }
+    std::pmr::memory_resource*        SparseSet::Resource() const { return m_Dense.get_allocator().resource(); }
+
+    void SparseSet::Reserve(uint32_t count)
+    {
+        if (m_Dense.capacity() < m_Dense.size() + count)
+        {
+            m_Dense.reserve(std::max<size_t>(m_Dense.size() + count, m_Dense.capacity() * 2));
+        }
+    }
+
+    uint32_t SparseSet::Insert(uint32_t id)
+    {
+        uint32_t& slot = Slot(id);
+        if (slot == None)
+        {
+            slot = m_Dense.size();
+            m_Dense.push_back(id);
+            ++m_Version;
+        }
+        return slot;
+    }
+    uint32_t SparseSet::Erase(uint32_t id)
+    {
+        uint32_t& slot  = Slot(id);
+        uint32_t  index = slot;
+        if (index != m_Dense.size() - 1)
+        {
+            m_Dense[index]       = m_Dense.back();
+            Slot(m_Dense[index]) = index;
+        }
+        m_Dense.pop_back();
+        slot = None;
+        ++m_Version;
+        return index;
+    }
+    void SparseSet::Clear()
+    {
+        for (uint32_t id : m_Dense)
+        {
+            Slot(id) = None;
+        }
+        m_Dense.clear();
+        ++m_Version;
+    }
+    uint32_t& SparseSet::Slot(uint32_t id)
+    {
+        if (m_Sparse.size() <= id / PageSize)
+        {
+            m_Sparse.resize(id / PageSize + 1, nullptr);
+        }
+        if (!m_Sparse[id / PageSize])
+        {
+            m_Sparse[id / PageSize] = static_cast<uint32_t*>(Resource()->allocate(PageSize * sizeof(uint32_t), alignof(uint32_t)));
+            std::fill_n(m_Sparse[id / PageSize], PageSize, None);
+        }
+        return m_Sparse[id / PageSize][id % PageSize];
+    }
+    void SparseSet::Swap(uint32_t a, uint32_t b)
+    {
+        std::swap(m_Dense[a], m_Dense[b]);
+        Slot(m_Dense[a]) = a;
+        Slot(m_Dense[b]) = b;
+        ++m_Version;
+    }
+    uint32_t SparseSet::Pages() const { return m_Sparse.size() - std::count(m_Sparse.begin(), m_Sparse.end(), nullptr); }
+    void     SparseSet::Save(SnapshotWriter& writer) const
+    {
+        writer.Align();
+        writer.Write(m_Dense.data(), m_Dense.size() * sizeof(uint32_t));
+        writer.Align();
+        for (uint32_t page = 0; page < m_Sparse.size(); ++page)
+        {
+            if (m_Sparse[page])
+            {
+                writer.Write(page);
+            }
+        }
+        writer.Align();
+        for (uint32_t* page : m_Sparse)
+        {
+            if (page)
+            {
+                writer.Write(page, PageSize * sizeof(uint32_t));
+            }
+        }
+    }
+    bool SparseSet::Verify(const SnapshotColumn& column, uint32_t entities)
+    {
+        const uint32_t               pages = uint32_t((uint64_t(entities) + PageSize - 1) / PageSize);
+        std::vector<const uint32_t*> sparse(pages, nullptr);
+        for (uint32_t i = 0; i < column.Pages; ++i)
+        {
+            const uint32_t page = column.PageIndices[i];
+            if (page >= pages || sparse[page])
+            {
+                return false;
+            }
+            sparse[page] = column.PageData + size_t(i) * PageSize;
+            for (uint32_t slot = 0; slot < PageSize; ++slot)
+            {
+                const uint32_t index = sparse[page][slot];
+                if (index != None && (index >= column.Count || column.Entities[index] != page * PageSize + slot))
+                {
+                    return false;
+                }
+            }
+        }
+        for (uint32_t i = 0; i < column.Count; ++i)
+        {
+            const uint32_t id = column.Entities[i];
+            if (id >= entities || !sparse[id / PageSize] || sparse[id / PageSize][id % PageSize] != i)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    // The sparse pages are stored as well, so a raw column is restored without touching its entities one by one.
+    void SparseSet::Restore(const SnapshotColumn& column)
+    {
+        ++m_Version;
+        m_Dense.assign(column.Entities, column.Entities + column.Count);
+        for (uint32_t i = 0; i < column.Pages; ++i)
+        {
+            uint32_t* page = &Slot(column.PageIndices[i] * PageSize);
+            std::memcpy(page, column.PageData + size_t(i) * PageSize, PageSize * sizeof(uint32_t));
+        }
+    }
+    void SparseSet::CopyFrom(const SparseSet& other)
+    {
+        ++m_Version;
+        m_Dense.assign(other.m_Dense.begin(), other.m_Dense.end());
+        for (uint32_t page = 0; page < std::max(m_Sparse.size(), other.m_Sparse.size()); ++page)
+        {
+            if (page < other.m_Sparse.size() && other.m_Sparse[page])
+            {
+                std::memcpy(&Slot(page * PageSize), other.m_Sparse[page], PageSize * sizeof(uint32_t));
+            }
+            else if (page < m_Sparse.size() && m_Sparse[page])
+            {
+                std::fill_n(m_Sparse[page], PageSize, None);
+            }
+        }
+    }
+
+    template <typename ComponentType> ComponentType* TagInstance()
+    {
+        static ComponentType instance;
+        return &instance;
+    }
+
+    IComponentArray::IComponentArray(std::pmr::memory_resource* resource) : SparseSet(resource), m_Ticks(resource) {}
+    ComponentTicks* IComponentArray::Ticks(uint32_t id)
+    {
+        uint32_t index = Index(id);
+        return (index == None ? nullptr : &m_Ticks[index]);
+    }
+    ComponentTicks* IComponentArray::TicksAt(uint32_t index) { return &m_Ticks[index]; }
+    // Position i holds entities[i] once step i is done, so every later swap only touches positions behind it.
+    void IComponentArray::Reorder(const uint32_t* entities, uint32_t count)
+    {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            Exchange(i, Index(entities[i]));
+        }
+    }
+
+    template <typename ComponentType>
+    ComponentArray<ComponentType>::ComponentArray(std::pmr::memory_resource* resource) : IComponentArray(resource), m_ComponentArray(resource)
+    {
+    }
+    // The type-erased add takes ownership of the caller's component.
+    template <typename ComponentType> void* ComponentArray<ComponentType>::AddComponent(uint32_t id, void* component, uint32_t tick)
+    {
+        return Emplace(id, tick, std::move(*reinterpret_cast<ComponentType*>(component)));
+    }
+    template <typename ComponentType> void*          ComponentArray<ComponentType>::GetComponent(uint32_t id) { return &m_ComponentArray[Index(id)]; }
+    template <typename ComponentType> ComponentType* ComponentArray<ComponentType>::Add(uint32_t id, const ComponentType& component, uint32_t tick)
+    {
+        return Emplace(id, tick, component);
+    }
+    template <typename ComponentType>
+    template <typename... Args>
+    ComponentType* ComponentArray<ComponentType>::Emplace(uint32_t id, uint32_t tick, Args&&... args)
+    {
+        uint32_t index = Insert(id);
+        if (index == m_ComponentArray.size())
+        {
+            m_ComponentArray.emplace_back(std::forward<Args>(args)...);
+            m_Ticks.push_back({tick, tick});
         }
         else
         {
-            m_ComponentArray[m_EntityToIndex[id]] = *reinterpret_cast<ComponentType*>(component);
+            Assign(m_ComponentArray[index], std::forward<Args>(args)...);
+            m_Ticks[index].Changed = tick;
+        }
+        return &m_ComponentArray[index];
+    }
+    template <typename ComponentType> template <typename... Args> void ComponentArray<ComponentType>::Assign(ComponentType& target, Args&&... args)
+    {
+        if constexpr (sizeof...(Args) == 1 && (std::is_same_v<std::decay_t<Args>, ComponentType> && ...))
+        {
+            target = (std::forward<Args>(args), ...);
+        }
+        else
+        {
+            target = ComponentType(std::forward<Args>(args)...);
+        }
+    }
+    template <typename ComponentType> ComponentType* ComponentArray<ComponentType>::Data() { return m_ComponentArray.data(); }
+    template <typename ComponentType> void           ComponentArray<ComponentType>::Reserve(uint32_t count)
+    {
+        SparseSet::Reserve(count);
+        if (m_ComponentArray.capacity() < m_ComponentArray.size() + count)
+        {
+            m_ComponentArray.reserve(std::max<size_t>(m_ComponentArray.size() + count, m_ComponentArray.capacity() * 2));
+            m_Ticks.reserve(m_ComponentArray.capacity());
         }
-        return &m_ComponentArray[m_EntityToIndex[id]];
     }
-    template <typename ComponentType> void* ComponentArray<ComponentType>::GetComponent(uint32_t id)
+    template <typename ComponentType> void           ComponentArray<ComponentType>::Clear()
+    {
+        SparseSet::Clear();
+        m_ComponentArray.clear();
+        m_Ticks.clear();
+    }
+    template <typename ComponentType> void           ComponentArray<ComponentType>::CopyFrom(const ComponentArray& other)
     {
-        return &m_ComponentArray[m_EntityToIndex[id]];
+        SparseSet::CopyFrom(other);
+        m_Ticks.assign(other.m_Ticks.begin(), other.m_Ticks.end());
+        m_ComponentArray.assign(other.m_ComponentArray.begin(), other.m_ComponentArray.end());
+    }
+    template <typename ComponentType> void           ComponentArray<ComponentType>::CopyChanged(const ComponentArray& other, uint32_t since)
+    {
+        for (uint32_t i = 0; i < other.m_Ticks.size(); ++i)
+        {
+            if (other.m_Ticks[i].Changed >= since)
+            {
+                m_ComponentArray[i] = other.m_ComponentArray[i];
+                m_Ticks[i]          = other.m_Ticks[i];
+            }
+        }
     }
-    template <typename ComponentType> void ComponentArray<ComponentType>::RemoveComponent(uint32_t id)
+    template <typename ComponentType> void           ComponentArray<ComponentType>::RemoveComponent(uint32_t id)
     {
-        if (m_EntityToIndex[id] != m_ComponentArray.size() - 1)
+        if (!Contains(id))
+        {
+            return;
+        }
+        uint32_t index = Erase(id);
+        if (index != m_ComponentArray.size() - 1)
         {
-            m_ComponentArray[m_EntityToIndex[id]] = m_ComponentArray.back();
+            m_ComponentArray[index] = std::move(m_ComponentArray.back());
+            m_Ticks[index]          = m_Ticks.back();
         }
         m_ComponentArray.pop_back();
+        m_Ticks.pop_back();
+    }
+    template <typename ComponentType> void ComponentArray<ComponentType>::Exchange(uint32_t a, uint32_t b)
+    {
+        if (a != b)
+        {
+            Swap(a, b);
+            std::swap(m_ComponentArray[a], m_ComponentArray[b]);
+            std::swap(m_Ticks[a], m_Ticks[b]);
+        }
+    }
+
+    template <typename ComponentType>
+    void ComponentArray<ComponentType>::Save(SnapshotWriter& writer, const std::string& name, const Serializer<ComponentType>& serializer) const
+    {
+        const bool raw = !serializer.Save;
+        writer.Write(SnapshotColumnHeader{uint32_t(name.size()), raw, sizeof(ComponentType), Size(), Pages()});
+        writer.Write(name.data(), name.size());
+        SparseSet::Save(writer);
+        writer.Align();
+        writer.Write(m_Ticks.data(), m_Ticks.size() * sizeof(ComponentTicks));
+        if (raw)
+        {
+            writer.Align();
+            writer.Write(m_ComponentArray.data(), m_ComponentArray.size() * sizeof(ComponentType));
+            return;
+        }
+        // The stream length is patched in once all components are written.
+        const size_t offset = writer.Offset();
+        writer.Write(uint64_t(0));
+        for (const ComponentType& component : m_ComponentArray)
+        {
+            serializer.Save(component, writer);
+        }
+        writer.Patch(offset, uint64_t(writer.Offset() - offset - sizeof(uint64_t)));
+    }
+    template <typename ComponentType> bool ComponentArray<ComponentType>::Load(const SnapshotColumn& column, const Serializer<ComponentType>& serializer)
+    {
+        Restore(column);
+        m_Ticks.assign(column.Ticks, column.Ticks + column.Count);
+        if constexpr (std::is_trivially_copyable_v<ComponentType>)
+        {
+            if (column.Raw)
+            {
+                const ComponentType* data = reinterpret_cast<const ComponentType*>(column.Data);
+                m_ComponentArray.assign(data, data + column.Count);
+                return true;
+            }
+        }
+        // Every entity of the column gets a component even when the stream runs short, so the pool stays whole.
+        SnapshotReader reader(column.Data, column.Bytes);
+        m_ComponentArray.reserve(column.Count);
+        for (uint32_t i = 0; i < column.Count; ++i)
+        {
+            m_ComponentArray.push_back(serializer.Load(reader));
+        }
+        return reader.Good();
     }
 
-}  // namespace ECS
\ No newline at end of file
+}  // namespace ECS
@@ -2,90 +2,654 @@
 
 namespace ECS
 {
-    bool Signature::Get(uint64_t id) const { return (m_Data.size() <= (id >> 6) ? false : (m_Data[id >> 6] >> (id & 63)) & 1); }
+    Signature::Signature(const allocator_type& allocator) : m_Overflow(allocator) {}
+    Signature::Signature(const Signature& other, const allocator_type& allocator) : m_Inline(other.m_Inline), m_Overflow(other.m_Overflow, allocator) {}
+    Signature::Signature(Signature&& other, const allocator_type& allocator)
+        : m_Inline(other.m_Inline), m_Overflow(std::move(other.m_Overflow), allocator)
+    {
+    }
+
+    bool Signature::Get(uint64_t id) const { return (Words() <= (id >> 6) ? false : (Word(id >> 6) >> (id & 63)) & 1); }
     void Signature::Set(uint64_t id, bool value)
     {
-        if (m_Data.size() <= id >> 6)
+        if (Words() <= id >> 6)
         {
-            m_Data.resize((id >> 6) + 1);
+            m_Overflow.resize(id >> 6);
         }
-        m_Data[id >> 6] &= ~(1 << (id & 63));
-        m_Data[id >> 6] |= ((uint64_t)value << (id & 63));
+        uint64_t& word = (id >> 6 == 0 ? m_Inline : m_Overflow[(id >> 6) - 1]);
+        word &= ~(uint64_t(1) << (id & 63));
+        word |= ((uint64_t)value << (id & 63));
     }
     bool Signature::Matches(const Signature& required) const
     {
         size_t i;
-        size_t mn = std::min(required.m_Data.size(), m_Data.size());
+        size_t mn = std::min(required.Words(), Words());
         for (i = 0; i < mn; ++i)
         {
-            if ((m_Data[i] & required.m_Data[i]) != required.m_Data[i])
+            if ((Word(i) & required.Word(i)) != required.Word(i))
+            {
+                return false;
+            }
+        }
+        while (i < required.Words())
+        {
+            if (required.Word(i++))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    bool Signature::Intersects(const Signature& other) const
+    {
+        size_t mn = std::min(other.Words(), Words());
+        for (size_t i = 0; i < mn; ++i)
+        {
+            if (Word(i) & other.Word(i))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+    bool Signature::operator==(const Signature& other) const
+    {
+        size_t mn = std::min(other.Words(), Words());
+        for (size_t i = 0; i < mn; ++i)
+        {
+            if (Word(i) != other.Word(i))
             {
                 return false;
             }
         }
-        while (i < required.m_Data.size())
+        const Signature& longer = (Words() > other.Words() ? *this : other);
+        for (size_t i = mn; i < longer.Words(); ++i)
         {
-            if (required.m_Data[i++])
+            if (longer.Word(i))
             {
                 return false;
             }
         }
         return true;
     }
+    size_t Signature::Hash() const
+    {
+        size_t res = 0;
+        for (size_t i = 0; i < Words(); ++i)
+        {
+            if (Word(i))
+            {
+                res ^= std::hash<uint64_t>()(Word(i)) + 0x9e3779b97f4a7c15 + (i << 6) + (res >> 2);
+            }
+        }
+        return res;
+    }
+    size_t Signature::Size() const
+    {
+        size_t size = 0;
+        for (size_t i = 0; i < Words(); ++i)
+        {
+            size += std::popcount(Word(i));
+        }
+        return size;
+    }
+    template <typename Func> void Signature::Each(Func&& func) const
+    {
+        for (size_t i = 0; i < Words(); ++i)
+        {
+            for (uint64_t word = Word(i); word; word &= word - 1)
+            {
+                func(uint32_t(i * 64 + std::countr_zero(word)));
+            }
+        }
+    }
+    void Signature::Mask(const Signature& other)
+    {
+        m_Inline &= other.m_Inline;
+        for (size_t i = 0; i < m_Overflow.size(); ++i)
+        {
+            m_Overflow[i] &= (i < other.m_Overflow.size() ? other.m_Overflow[i] : 0);
+        }
+    }
+    size_t   Signature::Words() const { return 1 + m_Overflow.size(); }
+    uint64_t Signature::Word(size_t i) const { return (i == 0 ? m_Inline : m_Overflow[i - 1]); }
+
+    SignatureMatrix::SignatureMatrix(std::pmr::memory_resource* resource) : m_Columns(resource) {}
 
-    template <typename ComponentType> ComponentType* ComponentManager::AddComponent(uint32_t entity_id, const ComponentType& component)
+    void SignatureMatrix::Set(uint32_t entity_id, uint32_t component_id, bool value)
     {
-        RegisterComponent<ComponentType>();
+        const size_t word = entity_id / 64;
+        if (m_Columns.size() <= component_id || m_Columns[component_id].size() <= word)
+        {
+            if (!value)
+            {
+                return;
+            }
+            if (m_Columns.size() <= component_id)
+            {
+                m_Columns.resize(component_id + 1);
+            }
+            m_Columns[component_id].resize((word / BlockWords + 1) * BlockWords, 0);
+        }
+        uint64_t& bits = m_Columns[component_id][word];
+        bits &= ~(uint64_t(1) << (entity_id % 64));
+        bits |= (uint64_t(value) << (entity_id % 64));
+    }
+    void SignatureMatrix::CopyColumn(const SignatureMatrix& other, uint32_t component_id)
+    {
+        if (m_Columns.size() <= component_id)
+        {
+            m_Columns.resize(component_id + 1);
+        }
+        if (component_id < other.m_Columns.size())
+        {
+            m_Columns[component_id].assign(other.m_Columns[component_id].begin(), other.m_Columns[component_id].end());
+        }
+        else
+        {
+            m_Columns[component_id].clear();
+        }
+    }
+    // Steps one word at a time, iterators advance entity by entity and mostly find the next match close by.
+    uint32_t SignatureMatrix::Next(const Signature& signature, uint32_t entity_id, uint32_t end) const
+    {
+        size_t words = SIZE_MAX;
+        signature.Each([this, &words](uint32_t component_id) { words = std::min(words, component_id < m_Columns.size() ? m_Columns[component_id].size() : 0); });
+        words = std::min(words, (size_t(end) + 63) / 64);
+        for (size_t word = entity_id / 64; word < words; ++word)
+        {
+            uint64_t bits = (word == entity_id / 64 ? ~uint64_t(0) << (entity_id % 64) : ~uint64_t(0));
+            signature.Each([this, &bits, word](uint32_t component_id) { bits &= m_Columns[component_id][word]; });
+            if (bits)
+            {
+                return std::min<uint32_t>(end, word * 64 + std::countr_zero(bits));
+            }
+        }
+        return end;
+    }
+    template <typename Func> void SignatureMatrix::Each(const Signature& signature, uint32_t begin, uint32_t end, Func&& func) const
+    {
+        std::vector<const uint64_t*> columns;
+        const size_t                 words = std::min(Columns(signature, columns), (size_t(end) + 63) / 64);
+        for (size_t block = begin / 64 / BlockWords * BlockWords; block < words; block += BlockWords)
+        {
+            uint64_t bits[BlockWords];
+            if (!Intersect(columns, block, bits))
+            {
+                continue;
+            }
+            for (size_t i = 0; i < BlockWords; ++i)
+            {
+                for (uint64_t word = bits[i]; word; word &= word - 1)
+                {
+                    const uint32_t entity_id = (block + i) * 64 + std::countr_zero(word);
+                    if (entity_id >= end)
+                    {
+                        return;
+                    }
+                    if (entity_id >= begin)
+                    {
+                        func(entity_id);
+                    }
+                }
+            }
+        }
+    }
+    // Bitsets are padded to whole blocks, so every column a signature holds covers the block.
+    size_t SignatureMatrix::Columns(const Signature& signature, std::vector<const uint64_t*>& columns) const
+    {
+        size_t words = SIZE_MAX;
+        signature.Each(
+            [this, &columns, &words](uint32_t component_id)
+            {
+                const bool present = component_id < m_Columns.size();
+                columns.push_back(present ? m_Columns[component_id].data() : nullptr);
+                words = std::min(words, present ? m_Columns[component_id].size() : 0);
+            });
+        return (columns.empty() ? 0 : words);
+    }
+    bool SignatureMatrix::Intersect(const std::vector<const uint64_t*>& columns, size_t block, uint64_t* bits)
+    {
+#if defined(__AVX2__)
+        static_assert(BlockWords * 64 == 256, "A block is one AVX2 register");
+        __m256i res = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(columns[0] + block));
+        for (size_t i = 1; i < columns.size(); ++i)
+        {
+            res = _mm256_and_si256(res, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(columns[i] + block)));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(bits), res);
+        return !_mm256_testz_si256(res, res);
+#else
+        uint64_t any = 0;
+        for (size_t i = 0; i < BlockWords; ++i)
+        {
+            bits[i] = columns[0][block + i];
+            for (size_t column = 1; column < columns.size(); ++column)
+            {
+                bits[i] &= columns[column][block + i];
+            }
+            any |= bits[i];
+        }
+        return any != 0;
+#endif
+    }
+
+    Query::Query(const Signature& signature, std::pmr::memory_resource* resource) : SparseSet(resource), m_Signature(signature) {}
+
+    const Signature&       Query::GetSignature() const { return m_Signature; }
+    const QueryStatistics& Query::Statistics() const { return m_Statistics; }
+
+    void Query::Update(uint32_t entity_id, const Signature& signature)
+    {
+        ++m_Statistics.Checks;
+        bool matches = signature.Matches(m_Signature);
+        if (matches && !Contains(entity_id))
+        {
+            Insert(entity_id);
+            ++m_Statistics.Inserts;
+        }
+        else if (!matches && Contains(entity_id))
+        {
+            Erase(entity_id);
+            ++m_Statistics.Erases;
+        }
+    }
+
+    OwningGroup::OwningGroup(const Signature& signature, std::vector<IComponentArray*> pools) : m_Signature(signature), m_Pools(std::move(pools)) {}
+
+    uint32_t         OwningGroup::Size() const { return m_Size; }
+    const Signature& OwningGroup::GetSignature() const { return m_Signature; }
+
+    bool OwningGroup::Contains(uint32_t entity_id) const { return m_Pools[0]->Index(entity_id) < m_Size; }
+    void OwningGroup::Enter(uint32_t entity_id)
+    {
+        if (!Contains(entity_id))
+        {
+            for (IComponentArray* pool : m_Pools)
+            {
+                pool->Exchange(pool->Index(entity_id), m_Size);
+            }
+            ++m_Size;
+        }
+    }
+    void OwningGroup::Leave(uint32_t entity_id)
+    {
+        if (Contains(entity_id))
+        {
+            --m_Size;
+            for (IComponentArray* pool : m_Pools)
+            {
+                pool->Exchange(pool->Index(entity_id), m_Size);
+            }
+        }
+    }
+    // Positions between the group and i were already found not to match, so entering swaps in nothing left to check.
+    void OwningGroup::Refresh(const std::pmr::vector<Signature>& signatures)
+    {
+        m_Size = 0;
+        for (uint32_t i = 0; i < m_Pools[0]->Size(); ++i)
+        {
+            uint32_t entity_id = m_Pools[0]->Entities()[i];
+            if (entity_id < signatures.size() && signatures[entity_id].Matches(m_Signature))
+            {
+                Enter(entity_id);
+            }
+        }
+    }
+
+    ComponentManager::ComponentManager(StorageMode mode, std::pmr::memory_resource* resource) :
+        m_Signatures(resource), m_Matrix(resource), m_ArchetypeManager(resource), m_Mode(mode), m_Resource(resource)
+    {
+    }
+
+    template <typename ComponentType, typename... Args> ComponentType* ComponentManager::EmplaceComponent(uint32_t entity_id, Args&&... args)
+    {
+        const uint32_t component_id = RegisterComponent<ComponentType>();
         ValidateSignature(entity_id);
-        m_Signatures[entity_id].Set(m_ComponentId[INDEX(ComponentType)], true);
-        return reinterpret_cast<ComponentType*>(
-            m_ComponentArrays[INDEX(ComponentType)]->AddComponent(entity_id, const_cast<ComponentType*>(&component)));
+        if (!m_Signatures[entity_id].Get(component_id))
+        {
+            SetSignature(entity_id, component_id, true);
+            UpdateQueries(entity_id, component_id);
+        }
+        if (m_Mode == StorageMode::Archetype)
+        {
+            return m_ArchetypeManager.Emplace<ComponentType>(entity_id, component_id, Tick(), std::forward<Args>(args)...);
+        }
+        if constexpr (IsTag<ComponentType>)
+        {
+            return TagInstance<ComponentType>();
+        }
+        ComponentArray<ComponentType>* pool = GetComponentArray<ComponentType>();
+        ComponentType*                 res  = pool->Emplace(entity_id, Tick(), std::forward<Args>(args)...);
+        return (EnterGroup(entity_id, component_id) ? pool->Data() + pool->Index(entity_id) : res);
+    }
+    template <typename ComponentType, typename... Args> ComponentType* ComponentManager::ReplaceComponent(uint32_t entity_id, Args&&... args)
+    {
+        ComponentType* res = GetComponent<ComponentType>(entity_id);
+        if (res)
+        {
+            ComponentArray<ComponentType>::Assign(*res, std::forward<Args>(args)...);
+        }
+        return res;
     }
     template <typename ComponentType> ComponentType* ComponentManager::GetComponent(uint32_t entity_id)
     {
-        ValidateSignature(entity_id);
         if (!HasComponent<ComponentType>(entity_id))
         {
             return nullptr;
         }
-        return reinterpret_cast<ComponentType*>(m_ComponentArrays[INDEX(ComponentType)]->GetComponent(entity_id));
+        if constexpr (IsTag<ComponentType>)
+        {
+            return TagInstance<ComponentType>();
+        }
+        // Handing out a mutable pointer counts as a write.
+        const uint32_t component_id = ComponentTypeId::Get<ComponentType>();
+        if (m_Mode == StorageMode::Archetype)
+        {
+            m_ArchetypeManager.GetTicks(entity_id, component_id)->Changed = Tick();
+            return reinterpret_cast<ComponentType*>(m_ArchetypeManager.GetComponent(entity_id, component_id));
+        }
+        ComponentArray<ComponentType>* pool  = GetComponentArray<ComponentType>();
+        uint32_t                       index = pool->Index(entity_id);
+        pool->Ticks(entity_id)->Changed      = Tick();
+        return pool->Data() + index;
     }
     template <typename ComponentType> void ComponentManager::RemoveComponent(uint32_t entity_id)
     {
-        ValidateSignature(entity_id);
         if (HasComponent<ComponentType>(entity_id))
         {
-            m_Signatures[entity_id].Set(m_ComponentId[INDEX(ComponentType)], false);
-            m_ComponentArrays[INDEX(ComponentType)]->RemoveComponent(entity_id);
+            const uint32_t component_id = ComponentTypeId::Get<ComponentType>();
+            SetSignature(entity_id, component_id, false);
+            UpdateQueries(entity_id, component_id);
+            if (m_Mode == StorageMode::Archetype)
+            {
+                m_ArchetypeManager.RemoveComponent(entity_id, component_id);
+            }
+            else if constexpr (!IsTag<ComponentType>)
+            {
+                LeaveGroup(entity_id, component_id);
+                m_ComponentArrays[component_id]->RemoveComponent(entity_id);
+            }
+        }
+    }
+    template <typename ComponentType> const ComponentType* ComponentManager::ReadComponent(uint32_t entity_id)
+    {
+        if (!HasComponent<ComponentType>(entity_id))
+        {
+            return nullptr;
+        }
+        if constexpr (IsTag<ComponentType>)
+        {
+            return TagInstance<ComponentType>();
+        }
+        if (m_Mode == StorageMode::Archetype)
+        {
+            return reinterpret_cast<const ComponentType*>(m_ArchetypeManager.GetComponent(entity_id, ComponentTypeId::Get<ComponentType>()));
         }
+        ComponentArray<ComponentType>* pool = GetComponentArray<ComponentType>();
+        return pool->Data() + pool->Index(entity_id);
     }
     template <typename ComponentType> bool ComponentManager::HasComponent(uint32_t entity_id) const
     {
-        if (m_Signatures.size() < entity_id + 1 || m_ComponentId.find(INDEX(ComponentType)) == m_ComponentId.end())
+        return entity_id < m_Signatures.size() && m_Signatures[entity_id].Get(ComponentTypeId::Get<ComponentType>());
+    }
+    template <typename ComponentType> void ComponentManager::Reserve(uint32_t count)
+    {
+        RegisterComponent<ComponentType>();
+        if (m_Mode == StorageMode::Pooled && !IsTag<ComponentType>)
         {
-            return false;
+            GetComponentArray<ComponentType>()->Reserve(count);
         }
-
-        return m_Signatures.at(entity_id).Get(m_ComponentId.at(INDEX(ComponentType)));
     }
+    template <typename ComponentType, typename Source> void ComponentManager::Insert(const uint32_t* ids, uint32_t count, Source&& source)
+    {
+        const uint32_t component_id = RegisterComponent<ComponentType>();
+        if (count == 0)
+        {
+            return;
+        }
+        if (m_Mode == StorageMode::Archetype)
+        {
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                EmplaceComponent<ComponentType>(ids[i], source());
+            }
+            return;
+        }
+        ValidateSignature(*std::max_element(ids, ids + count));
+        ComponentArray<ComponentType>* pool = GetComponentArray<ComponentType>();
+        const uint32_t                 tick = Tick();
+        if constexpr (!IsTag<ComponentType>)
+        {
+            pool->Reserve(count);
+        }
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (!m_Signatures[ids[i]].Get(component_id))
+            {
+                SetSignature(ids[i], component_id, true);
+                UpdateQueries(ids[i], component_id);
+            }
+            if constexpr (!IsTag<ComponentType>)
+            {
+                pool->Add(ids[i], source(), tick);
+                EnterGroup(ids[i], component_id);
+            }
+        }
+    }
+    template <typename... Components> void ComponentManager::Spawn(const std::vector<uint32_t>& ids, const Components&... components)
+    {
+        if (m_Mode == StorageMode::Pooled || sizeof...(Components) == 0)
+        {
+            (Insert<Components>(ids.data(), ids.size(), [&components]() -> const Components& { return components; }), ...);
+            return;
+        }
+        (RegisterComponent<Components>(), ...);
+        if (!ids.empty())
+        {
+            ValidateSignature(*std::max_element(ids.begin(), ids.end()));
+        }
+        const Signature& signature = BuildSignature<Components...>();
+        ++m_Version;
+        for (uint32_t id : ids)
+        {
+            m_Signatures[id] = signature;
+            (m_Matrix.Set(id, ComponentTypeId::Get<Components>(), true), ...);
+            (UpdateQueries(id, ComponentTypeId::Get<Components>()), ...);
+        }
+        m_ArchetypeManager.Spawn(ids, signature, Tick(), components...);
+    }
+    // Breadth-first from the roots: the order is sorted by depth, and every level lists the children grouped in the order of
+    // their parents, so the parent lookups of a propagation pass walk the previous level front to back.
+    template <typename... Components> void ComponentManager::SortHierarchy()
+    {
+        ComponentArray<Hierarchy>* pool = GetComponentArray<Hierarchy>();
+        if (m_Mode == StorageMode::Archetype || !pool || GroupOf(ComponentTypeId::Get<Hierarchy>()))
+        {
+            return;
+        }
+        std::vector<uint32_t> order;
+        order.reserve(pool->Size());
+        for (uint32_t i = 0; i < pool->Size(); ++i)
+        {
+            if (pool->Data()[i].Parent == EntityManager::Null)
+            {
+                order.push_back(pool->Entities()[i]);
+            }
+        }
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            uint32_t child = pool->Data()[pool->Index(order[i])].FirstChild;
+            for (; child != EntityManager::Null; child = pool->Data()[pool->Index(child)].NextSibling)
+            {
+                order.push_back(child);
+            }
+        }
+        pool->Reorder(order.data(), order.size());
+        (Follow<Components>(order), ...);
+    }
+    // Group members and the rest of the pool are sorted separately, the owned pools then take the members' new order.
+    template <typename ComponentType, typename Compare> void ComponentManager::Sort(Compare& compare)
+    {
+        static_assert(!IsTag<ComponentType>, "Tags have no values to sort by");
+        const uint32_t component_id = RegisterComponent<ComponentType>();
+        if (m_Mode == StorageMode::Archetype)
+        {
+            m_ArchetypeManager.Sort<ComponentType>(component_id, compare);
+            return;
+        }
+        ComponentArray<ComponentType>* pool  = GetComponentArray<ComponentType>();
+        OwningGroup*                   group = GroupOf(component_id);
+        const ComponentType*           data  = pool->Data();
+        const uint32_t                 split = (group ? group->Size() : 0);
+        std::vector<uint32_t>          order(pool->Size());
+        std::iota(order.begin(), order.end(), 0);
+        auto less = [&compare, data](uint32_t a, uint32_t b) { return compare(data[a], data[b]); };
+        std::sort(order.begin(), order.begin() + split, less);
+        std::sort(order.begin() + split, order.end(), less);
+        for (uint32_t& index : order)
+        {
+            index = pool->Entities()[index];
+        }
+        if (group)
+        {
+            for (IComponentArray* owned : group->m_Pools)
+            {
+                if (owned != pool)
+                {
+                    owned->Reorder(order.data(), split);
+                }
+            }
+        }
+        pool->Reorder(order.data(), order.size());
+    }
+    template <typename Leader, typename Follower> void ComponentManager::Sort()
+    {
+        ComponentArray<Leader>* leader = GetComponentArray<Leader>();
+        if (m_Mode == StorageMode::Pooled && leader)
+        {
+            Follow<Follower>(std::vector<uint32_t>(leader->Entities().begin(), leader->Entities().end()));
+        }
+    }
+    // Only the pools, groups and queries of the entity's own components are visited. Every group is left before any pool
+    // shrinks, leaving swaps components in all pools the group owns.
     void ComponentManager::Destroy(uint32_t entity_id)
     {
-        for (const auto& [id, array] : m_ComponentArrays)
+        m_ArchetypeManager.Destroy(entity_id);
+        if (m_Signatures.size() <= entity_id)
+        {
+            return;
+        }
+        const Signature signature = std::exchange(m_Signatures[entity_id], Signature());
+        ++m_Version;
+        if (m_Mode == StorageMode::Pooled)
+        {
+            signature.Each([this, entity_id](uint32_t component_id) { LeaveGroup(entity_id, component_id); });
+            signature.Each(
+                [this, entity_id](uint32_t component_id)
+                {
+                    if (IComponentArray* pool = m_ComponentArrays[component_id].get())
+                    {
+                        pool->RemoveComponent(entity_id);
+                    }
+                });
+        }
+        signature.Each(
+            [this, entity_id](uint32_t component_id)
+            {
+                m_Matrix.Set(entity_id, component_id, false);
+                UpdateQueries(entity_id, component_id);
+            });
+    }
+    template <typename Func> void ComponentManager::EachComponent(uint32_t entity_id, Func&& func) const
+    {
+        if (entity_id < m_Signatures.size())
+        {
+            m_Signatures[entity_id].Each(func);
+        }
+    }
+    // Pooled storage filters the smallest of the pools, or every signature when all of Components are tags. Archetype
+    // storage lists the rows of every matching archetype.
+    template <typename... Components> std::vector<uint32_t> ComponentManager::Collect() const
+    {
+        static_assert(sizeof...(Components) > 0, "Collect needs at least one component");
+        const Signature&      signature = BuildSignature<Components...>();
+        std::vector<uint32_t> res;
+        if (m_Mode == StorageMode::Archetype)
+        {
+            for (Archetype* archetype : m_ArchetypeManager.Matching(signature))
+            {
+                res.insert(res.end(), archetype->Entities().begin(), archetype->Entities().end());
+            }
+            return res;
+        }
+        const IComponentArray* smallest = nullptr;
+        for (uint32_t component_id : {ComponentTypeId::Get<Components>()...})
+        {
+            if (m_ComponentInfos.size() <= component_id || m_ComponentInfos[component_id].Alignment == 0)
+            {
+                return res;
+            }
+            const IComponentArray* pool = m_ComponentArrays[component_id].get();
+            smallest                    = (pool && (!smallest || pool->Size() < smallest->Size()) ? pool : smallest);
+        }
+        if (!smallest)
+        {
+            m_Matrix.Each(signature, 0, m_Signatures.size(), [&res](uint32_t entity_id) { res.push_back(entity_id); });
+            return res;
+        }
+        for (uint32_t entity_id : smallest->Entities())
+        {
+            if (Matches(entity_id, signature))
+            {
+                res.push_back(entity_id);
+            }
+        }
+        return res;
+    }
+    // In pooled storage the pool is cleared at once. No entity matches its group afterwards, so the group only has to
+    // forget its members, the other pools keep their order.
+    template <typename ComponentType> uint32_t ComponentManager::RemoveAll()
+    {
+        if (m_Mode == StorageMode::Archetype || IsTag<ComponentType>)
+        {
+            const std::vector<uint32_t> ids = Collect<ComponentType>();
+            for (uint32_t entity_id : ids)
+            {
+                RemoveComponent<ComponentType>(entity_id);
+            }
+            return ids.size();
+        }
+        ComponentArray<ComponentType>* pool = GetComponentArray<ComponentType>();
+        if (!pool)
         {
-            array->RemoveComponent(entity_id);
+            return 0;
         }
-        m_Signatures[entity_id] = Signature();
+        const uint32_t component_id = ComponentTypeId::Get<ComponentType>();
+        const uint32_t count        = pool->Size();
+        for (uint32_t entity_id : pool->Entities())
+        {
+            SetSignature(entity_id, component_id, false);
+            UpdateQueries(entity_id, component_id);
+        }
+        pool->Clear();
+        if (OwningGroup* group = GroupOf(component_id))
+        {
+            group->Refresh(m_Signatures);
+        }
+        return count;
     }
 
-    template <typename... Components> Signature ComponentManager::BuildSignature()
+    // Component ids are global, so the signature of a component list is computed once per instantiation.
+    template <typename... Components> const Signature& ComponentManager::BuildSignature()
     {
-        if (!ValidateComponents<Components...>())
+        static const Signature signature = []
         {
             Signature res;
-            res.Set(m_ComponentId.size(), true);
+            (res.Set(ComponentTypeId::Get<Components>(), true), ...);
             return res;
-        }
-        return GetSignature<Components...>();
+        }();
+        return signature;
     }
     bool ComponentManager::Matches(uint32_t id, const Signature& signature) const
     {
@@ -93,48 +657,423 @@ namespace ECS
         {
             return false;
         }
-        // printf("Cheking %u...\n", id);
-        // m_Signatures.at(id).Print();
-        return m_Signatures.at(id).Matches(signature);
+        return m_Signatures[id].Matches(signature);
     }
+    StorageMode ComponentManager::Mode() const { return m_Mode; }
 
-    template <typename... Components> typename std::enable_if<sizeof...(Components) == 0, bool>::type ComponentManager::ValidateComponents() const
+    uint32_t        ComponentManager::Tick() const { return m_Tick.load(std::memory_order_relaxed); }
+    uint32_t        ComponentManager::AdvanceTick() { return m_Tick.fetch_add(1, std::memory_order_relaxed); }
+    ComponentTicks* ComponentManager::Ticks(uint32_t entity_id, uint32_t component_id)
     {
-        return true;
+        if (entity_id >= m_Signatures.size() || !m_Signatures[entity_id].Get(component_id))
+        {
+            return nullptr;
+        }
+        if (m_Mode == StorageMode::Archetype)
+        {
+            return m_ArchetypeManager.GetTicks(entity_id, component_id);
+        }
+        IComponentArray* pool = m_ComponentArrays[component_id].get();
+        return (pool ? pool->Ticks(entity_id) : nullptr);
+    }
+
+    const Query& ComponentManager::RegisterQuery(const Signature& signature)
+    {
+        // An empty signature would match dead ids as well, and nothing would ever erase them.
+        assert(signature.Size() != 0 && "Cached query needs at least one component");
+        std::lock_guard<std::mutex> lock(m_QueryMutex);
+        auto&                       query = m_Queries[signature];
+        if (!query)
+        {
+            query = std::make_unique<Query>(signature, m_Resource);
+            m_Matrix.Each(signature, 0, m_Signatures.size(), [this, &query](uint32_t entity_id) { query->Update(entity_id, m_Signatures[entity_id]); });
+            for (uint32_t component_id = 0; component_id < ComponentTypeId::Count(); ++component_id)
+            {
+                if (signature.Get(component_id))
+                {
+                    if (m_ComponentQueries.size() <= component_id)
+                    {
+                        m_ComponentQueries.resize(component_id + 1);
+                    }
+                    m_ComponentQueries[component_id].push_back(query.get());
+                }
+            }
+        }
+        return *query;
+    }
+    Query* ComponentManager::FindQuery(const Signature& signature)
+    {
+        std::lock_guard<std::mutex> lock(m_QueryMutex);
+        auto                        it = m_Queries.find(signature);
+        if (it == m_Queries.end())
+        {
+#ifdef ECS_PROFILE
+            ++m_QueryMisses[signature];
+#endif
+            return nullptr;
+        }
+        ++it->second->m_Statistics.Hits;
+        return it->second.get();
+    }
+#ifdef ECS_PROFILE
+    uint64_t ComponentManager::QueryMisses(const Signature& signature) const
+    {
+        std::lock_guard<std::mutex> lock(m_QueryMutex);
+        auto                        it = m_QueryMisses.find(signature);
+        return (it == m_QueryMisses.end() ? 0 : it->second);
+    }
+#endif
+
+    template <typename ComponentType>
+    void ComponentManager::RegisterSnapshot(const std::string& name, const Serializer<ComponentType>& serializer)
+    {
+        const uint32_t component_id = RegisterComponent<ComponentType>();
+        auto           save         = [this, name, serializer](SnapshotWriter& writer)
+        {
+            // Tags are written as a column of their entities, the one byte per entity of an empty type is their data.
+            if constexpr (IsTag<ComponentType>)
+            {
+                ComponentArray<ComponentType> pool(m_Resource);
+                for (uint32_t entity_id : Collect<ComponentType>())
+                {
+                    pool.Add(entity_id, ComponentType(), 0);
+                }
+                pool.Save(writer, name, serializer);
+                return;
+            }
+            if (m_Mode == StorageMode::Pooled)
+            {
+                GetComponentArray<ComponentType>()->Save(writer, name, serializer);
+                return;
+            }
+            // Archetype rows are gathered into a pool first, so both modes write the same column layout.
+            ComponentArray<ComponentType> pool(m_Resource);
+            const uint32_t                component_id = ComponentTypeId::Get<ComponentType>();
+            for (Archetype* archetype : m_ArchetypeManager.Matching(BuildSignature<ComponentType>()))
+            {
+                int32_t column = archetype->ColumnIndex(component_id);
+                for (uint32_t row = 0; row < archetype->Size(); ++row)
+                {
+                    uint32_t entity_id = archetype->Entities()[row];
+                    pool.Add(entity_id, *reinterpret_cast<ComponentType*>(archetype->At(column, row)), 0);
+                    *pool.Ticks(entity_id) = *archetype->TicksAt(column, row);
+                }
+            }
+            pool.Save(writer, name, serializer);
+        };
+        // Signatures and archetypes are rebuilt from the entity lists before any column is loaded, tags need nothing more.
+        auto load = [this, serializer](const SnapshotColumn& column)
+        {
+            if constexpr (IsTag<ComponentType>)
+            {
+                return true;
+            }
+            if (m_Mode == StorageMode::Pooled)
+            {
+                return GetComponentArray<ComponentType>()->Load(column, serializer);
+            }
+            // Entities already sit in the archetype of their final signature, only their components are constructed.
+            const uint32_t component_id = ComponentTypeId::Get<ComponentType>();
+            SnapshotReader reader(column.Data, column.Bytes);
+            for (uint32_t i = 0; i < column.Count; ++i)
+            {
+                void* component = m_ArchetypeManager.GetComponent(column.Entities[i], component_id);
+                *m_ArchetypeManager.GetTicks(column.Entities[i], component_id) = column.Ticks[i];
+                if constexpr (std::is_trivially_copyable_v<ComponentType>)
+                {
+                    if (column.Raw)
+                    {
+                        std::memcpy(component, column.Data + size_t(i) * sizeof(ComponentType), sizeof(ComponentType));
+                        continue;
+                    }
+                }
+                new (component) ComponentType(serializer.Load(reader));
+            }
+            return reader.Good();
+        };
+        m_SnapshotTypes.push_back({name, component_id, !serializer.Save, sizeof(ComponentType), save, load});
     }
-    template <typename T, typename... Components> bool ComponentManager::ValidateComponents() const
+    void ComponentManager::SaveSnapshot(SnapshotWriter& writer)
     {
-        if (m_ComponentId.find(INDEX(T)) == m_ComponentId.end())
+        writer.Write(uint32_t(m_SnapshotTypes.size()));
+        for (const SnapshotType& type : m_SnapshotTypes)
         {
+            type.Save(writer);
+        }
+    }
+    bool ComponentManager::LoadSnapshot(const std::vector<SnapshotColumn>& columns, uint32_t entities, uint32_t tick)
+    {
+        std::vector<std::pair<const SnapshotColumn*, const SnapshotType*>> matched;
+        for (const SnapshotColumn& column : columns)
+        {
+            auto type = std::find_if(m_SnapshotTypes.begin(), m_SnapshotTypes.end(), [&column](const SnapshotType& type) { return type.Name == column.Name; });
+            if (type == m_SnapshotTypes.end())
+            {
+                continue;
+            }
+            if (type->Raw != column.Raw || (column.Raw && type->Size != column.Size) || !SparseSet::Verify(column, entities))
+            {
+                return false;
+            }
+            matched.emplace_back(&column, &*type);
+        }
+        // Component ids depend on the order types are first used in a process, so signatures are rebuilt from the columns.
+        m_Signatures.resize(entities);
+        ++m_Version;
+        for (const auto& [column, type] : matched)
+        {
+            for (uint32_t i = 0; i < column->Count; ++i)
+            {
+                SetSignature(column->Entities[i], type->ComponentId, true);
+            }
+        }
+        if (m_Mode == StorageMode::Archetype)
+        {
+            for (uint32_t entity_id = 0; entity_id < entities; ++entity_id)
+            {
+                if (m_Signatures[entity_id].Size() != 0)
+                {
+                    m_ArchetypeManager.Place(entity_id, m_Signatures[entity_id]);
+                }
+            }
+        }
+        bool good = true;
+        for (const auto& [column, type] : matched)
+        {
+            good &= type->Load(*column);
+        }
+        for (const auto& [signature, query] : m_Queries)
+        {
+            for (uint32_t entity_id = 0; entity_id < entities; ++entity_id)
+            {
+                query->Update(entity_id, m_Signatures[entity_id]);
+            }
+        }
+        for (const auto& group : m_Groups)
+        {
+            group->Refresh(m_Signatures);
+        }
+        // A serialized column that ran short still constructed all of its components, they are destroyed with the rest.
+        if (!good)
+        {
+            for (uint32_t entity_id = 0; entity_id < entities; ++entity_id)
+            {
+                Destroy(entity_id);
+            }
             return false;
         }
-        return ValidateComponents<Components...>();
+        m_Tick.store(tick, std::memory_order_relaxed);
+        return true;
+    }
+    // Signatures are masked whole and matrix bitsets copied whole, only the archetype pools are gathered row by row.
+    // The tick of this manager is the source's tick at the previous copy, every write since then is stamped at or after it.
+    template <typename... Components> void ComponentManager::CopyFrom(const ComponentManager& source)
+    {
+        const uint32_t since   = Tick();
+        const bool     current = m_Mirror.Matches(&source, source.m_Version, m_Version);
+        if (!current)
+        {
+            const Signature& mask = BuildSignature<Components...>();
+            m_Signatures.resize(source.m_Signatures.size());
+            for (size_t i = 0; i < m_Signatures.size(); ++i)
+            {
+                m_Signatures[i] = source.m_Signatures[i];
+                m_Signatures[i].Mask(mask);
+            }
+            ++m_Version;
+        }
+        (CopyType<Components>(source, current, since), ...);
+        m_Mirror = {&source, source.m_Version, m_Version};
+        m_Tick.store(source.Tick(), std::memory_order_relaxed);
     }
 
-    template <typename... Components> typename std::enable_if<sizeof...(Components) == 0, Signature>::type ComponentManager::GetSignature() const
+    template <typename... Components> const OwningGroup* ComponentManager::RegisterGroup()
     {
-        return Signature();
+        static_assert(!(IsTag<Components> || ...), "Tags have no pool to own");
+        if (m_Mode == StorageMode::Archetype)
+        {
+            return nullptr;
+        }
+        (RegisterComponent<Components>(), ...);
+        const Signature& signature = BuildSignature<Components...>();
+        for (const auto& group : m_Groups)
+        {
+            if (group->GetSignature() == signature)
+            {
+                return group.get();
+            }
+        }
+        if ((GroupOf(ComponentTypeId::Get<Components>()) || ...))
+        {
+            return nullptr;
+        }
+        m_Groups.push_back(std::make_unique<OwningGroup>(signature, std::vector<IComponentArray*>{GetComponentArray<Components>()...}));
+        for (uint32_t component_id : {ComponentTypeId::Get<Components>()...})
+        {
+            if (m_ComponentGroups.size() <= component_id)
+            {
+                m_ComponentGroups.resize(component_id + 1, nullptr);
+            }
+            m_ComponentGroups[component_id] = m_Groups.back().get();
+        }
+        m_Groups.back()->Refresh(m_Signatures);
+        return m_Groups.back().get();
     }
-    template <typename T, typename... Components> Signature ComponentManager::GetSignature() const
+    // Only a view over exactly the owned components can be served by a group: one over fewer also matches entities
+    // outside the group region.
+    const OwningGroup* ComponentManager::FindGroup(const Signature& signature) const
     {
-        Signature res = GetSignature<Components...>();
-        res.Set(m_ComponentId.at(INDEX(T)), true);
-        return res;
+        for (const auto& group : m_Groups)
+        {
+            if (group->GetSignature() == signature)
+            {
+                return group.get();
+            }
+        }
+        return nullptr;
     }
 
     void ComponentManager::ValidateSignature(uint32_t entity_id)
     {
-        while (m_Signatures.size() < entity_id + 1)
+        if (m_Signatures.size() <= entity_id)
+        {
+            m_Signatures.resize(entity_id + 1);
+            ++m_Version;
+        }
+    }
+    // Keeps the entity's signature and the matrix in step. Spawn and Destroy write whole signatures and the matrix themselves.
+    void ComponentManager::SetSignature(uint32_t entity_id, uint32_t component_id, bool value)
+    {
+        m_Signatures[entity_id].Set(component_id, value);
+        m_Matrix.Set(entity_id, component_id, value);
+        ++m_Version;
+    }
+    void ComponentManager::UpdateQueries(uint32_t entity_id, uint32_t component_id)
+    {
+        if (component_id < m_ComponentQueries.size())
+        {
+            for (Query* query : m_ComponentQueries[component_id])
+            {
+                query->Update(entity_id, m_Signatures[entity_id]);
+            }
+        }
+    }
+    OwningGroup* ComponentManager::GroupOf(uint32_t component_id) const
+    {
+        return (component_id < m_ComponentGroups.size() ? m_ComponentGroups[component_id] : nullptr);
+    }
+    // Called once the component is in its pool, returns whether the entity moved into the group.
+    bool ComponentManager::EnterGroup(uint32_t entity_id, uint32_t component_id)
+    {
+        OwningGroup* group = GroupOf(component_id);
+        if (!group || group->Contains(entity_id) || !m_Signatures[entity_id].Matches(group->GetSignature()))
+        {
+            return false;
+        }
+        group->Enter(entity_id);
+        return true;
+    }
+    // Called while the component is still in its pool.
+    void ComponentManager::LeaveGroup(uint32_t entity_id, uint32_t component_id)
+    {
+        if (OwningGroup* group = GroupOf(component_id))
         {
-            m_Signatures.push_back(Signature());
+            group->Leave(entity_id);
         }
     }
-    template <typename ComponentType> void ComponentManager::RegisterComponent()
+    template <typename ComponentType> uint32_t ComponentManager::RegisterComponent()
     {
-        if (m_ComponentId.find(INDEX(ComponentType)) == m_ComponentId.end())
+        const uint32_t component_id = ComponentTypeId::Get<ComponentType>();
+        if (m_ComponentInfos.size() <= component_id)
         {
-            m_ComponentId[INDEX(ComponentType)]     = m_ComponentId.size();
-            m_ComponentArrays[INDEX(ComponentType)] = std::make_shared<ComponentArray<ComponentType>>(ComponentArray<ComponentType>());
+            m_ComponentInfos.resize(component_id + 1);
+            m_ComponentArrays.resize(component_id + 1);
+        }
+        if (m_ComponentInfos[component_id].Alignment == 0)
+        {
+            m_ComponentInfos[component_id] = ComponentInfo::Create<ComponentType>();
+            if (m_Mode == StorageMode::Archetype)
+            {
+                m_ArchetypeManager.RegisterComponent(component_id, m_ComponentInfos[component_id]);
+            }
+            else if constexpr (!IsTag<ComponentType>)
+            {
+                m_ComponentArrays[component_id] = std::make_unique<ComponentArray<ComponentType>>(m_Resource);
+            }
+        }
+        return component_id;
+    }
+    template <typename ComponentType> ComponentArray<ComponentType>* ComponentManager::GetComponentArray() const
+    {
+        const uint32_t component_id = ComponentTypeId::Get<ComponentType>();
+        return (component_id < m_ComponentArrays.size() ? static_cast<ComponentArray<ComponentType>*>(m_ComponentArrays[component_id].get()) : nullptr);
+    }
+    // Moves the entities of order that hold ComponentType to the front of its pool, in the same order.
+    template <typename ComponentType> void ComponentManager::Follow(const std::vector<uint32_t>& order)
+    {
+        ComponentArray<ComponentType>* pool = GetComponentArray<ComponentType>();
+        if (!pool || GroupOf(ComponentTypeId::Get<ComponentType>()))
+        {
+            return;
+        }
+        std::vector<uint32_t> present;
+        present.reserve(std::min<size_t>(order.size(), pool->Size()));
+        for (uint32_t id : order)
+        {
+            if (pool->Contains(id))
+            {
+                present.push_back(id);
+            }
+        }
+        pool->Reorder(present.data(), present.size());
+    }
+    template <typename ComponentType> void ComponentManager::CopyType(const ComponentManager& source, bool signatures, uint32_t since)
+    {
+        const uint32_t component_id = RegisterComponent<ComponentType>();
+        if (!signatures)
+        {
+            m_Matrix.CopyColumn(source.m_Matrix, component_id);
+        }
+        if constexpr (!IsTag<ComponentType>)
+        {
+            ComponentArray<ComponentType>* pool = GetComponentArray<ComponentType>();
+            if (source.m_Mode == StorageMode::Pooled)
+            {
+                if (const ComponentArray<ComponentType>* from = source.GetComponentArray<ComponentType>())
+                {
+                    if (m_PoolMirrors.size() <= component_id)
+                    {
+                        m_PoolMirrors.resize(component_id + 1);
+                    }
+                    Mirror& mirror = m_PoolMirrors[component_id];
+                    if (mirror.Matches(from, from->Version(), pool->Version()))
+                    {
+                        pool->CopyChanged(*from, since);
+                    }
+                    else
+                    {
+                        pool->CopyFrom(*from);
+                    }
+                    mirror = {from, from->Version(), pool->Version()};
+                }
+                else
+                {
+                    pool->Clear();
+                }
+                return;
+            }
+            pool->Clear();
+            for (Archetype* archetype : source.m_ArchetypeManager.Matching(BuildSignature<ComponentType>()))
+            {
+                const int32_t column = archetype->ColumnIndex(component_id);
+                pool->Reserve(archetype->Size());
+                for (uint32_t row = 0; row < archetype->Size(); ++row)
+                {
+                    const uint32_t entity_id = archetype->Entities()[row];
+                    pool->Add(entity_id, *reinterpret_cast<const ComponentType*>(archetype->At(column, row)), 0);
+                    *pool->Ticks(entity_id) = *archetype->TicksAt(column, row);
+                }
+            }
         }
     }
 }  // namespace ECS
\ No newline at end of file
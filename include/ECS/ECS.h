@@ -3,10 +3,38 @@
 #include <vector>
 #include <unordered_map>
 #include <memory>
-#include <typeindex>
+#include <memory_resource>
 #include <queue>
-
-#define INDEX(type) std::type_index(typeid(type))
+#include <string>
+#include <new>
+#include <cstddef>
+#include <algorithm>
+#include <numeric>
+#include <tuple>
+#include <array>
+#include <utility>
+#include <type_traits>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <bit>
+#include <span>
+#include <chrono>
+#include <cstring>
+#include <cassert>
+#include <fstream>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 namespace ECS
 {
@@ -16,113 +44,859 @@ namespace ECS
     class Storage;
     class System;
     class IComponentArray;
+    class Archetype;
+    class ArchetypeManager;
+    class Query;
+    class OwningGroup;
     class ComponentManager;
     class EntityManager;
     class SystemManager;
+    class ThreadPool;
+    class CommandBuffer;
+    class SnapshotWriter;
+    class SnapshotReader;
+    struct SnapshotColumn;
+    template <typename ComponentType> struct Serializer;
     template <typename... Components> class StorageView;
+    template <typename... Components> class ViewEntry;
+    template <typename... Components> class FrameBuffer;
     template <typename ComponentType> class ComponentArray;
 
+    // Pooled keeps one ComponentArray per component type, Archetype packs entities with equal signatures into chunks.
+    enum class StorageMode
+    {
+        Pooled,
+        Archetype
+    };
+
+    //*___TYPE_ID___________________________________________________________________________________________________________________________________________________________________________________________
+
+    // Sequential ids handed out on first use of each type within a family, shared by every Storage.
+    template <typename Family> class TypeId
+    {
+    public:
+        template <typename T> static uint32_t Get();
+        static uint32_t                       Count();
+
+    private:
+        static inline std::atomic<uint32_t> s_Next = 0;
+    };
+    using ComponentTypeId = TypeId<IComponentArray>;
+    using SystemTypeId    = TypeId<System>;
+    using ResourceTypeId  = TypeId<Storage>;
+
+    //*___MEMORY___________________________________________________________________________________________________________________________________________________________________________________________
+
+    // Page arena for the memory of one Storage. Blocks are rounded up to power-of-two size classes and carved from pages taken
+    // from the upstream resource; freed blocks go to a per-class free list, so fixed-size archetype chunks and geometrically
+    // growing pools reuse memory without reaching upstream. Blocks above a quarter page go straight to upstream.
+    // Release hands the pages back to upstream only when no block is in use and returns false otherwise, so it is no
+    // shortcut for dropping a world: its Storages have to be destroyed first, which frees their memory block by block.
+    // The destructor frees everything regardless, the arena has to outlive its Storages.
+    // Like the rest of a Storage's structure, the arena is not thread-safe.
+    class PageArena : public std::pmr::memory_resource
+    {
+    public:
+        static constexpr size_t MinBlock      = 64;
+        static constexpr size_t PageAlignment = 4096;
+
+        PageArena(size_t page_size = 1 << 20, std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+        ~PageArena();
+        PageArena(const PageArena&)            = delete;
+        PageArena& operator=(const PageArena&) = delete;
+
+        bool   Release();
+        size_t Allocated() const;
+
+    private:
+        struct Block
+        {
+            Block* Next;
+        };
+        struct Large
+        {
+            void*  Pointer;
+            size_t Bytes;
+            size_t Alignment;
+        };
+
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void  do_deallocate(void* ptr, size_t bytes, size_t alignment) override;
+        bool  do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+        static size_t SizeClass(size_t bytes);
+        void          Free();
+
+        std::pmr::memory_resource* m_Upstream;
+        size_t                     m_PageSize;
+        std::vector<void*>         m_Pages;
+        std::vector<Large>         m_Large;
+        std::vector<Block*>        m_FreeLists;
+        std::byte*                 m_Cursor;
+        std::byte*                 m_End;
+        size_t                     m_Allocated;
+    };
+
     //*___COMPONENT_MANAGER___________________________________________________________________________________________________________________________________________________________________________________________
 
-    class IComponentArray
+    // Paged sparse set: m_Sparse maps entity id to a position in m_Dense, m_Dense lists the entities in pool order.
+    class SparseSet
+    {
+    public:
+        static constexpr uint32_t PageSize = 1024;
+        static constexpr uint32_t None     = UINT32_MAX;
+
+        SparseSet(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+        ~SparseSet();
+        SparseSet(const SparseSet&)            = delete;
+        SparseSet& operator=(const SparseSet&) = delete;
+
+        bool                              Contains(uint32_t id) const;
+        uint32_t                          Index(uint32_t id) const;
+        uint32_t                          Size() const;
+        // Changes whenever an id enters, leaves or moves, a copy with the same ids in the same order only needs new values.
+        uint64_t                          Version() const;
+        const std::pmr::vector<uint32_t>& Entities() const;
+        void                              Reserve(uint32_t count);
+        std::pmr::memory_resource*        Resource() const;
+
+        // Checks a snapshot column before Restore trusts it: pages and dense ids within the snapshot's entities, every
+        // sparse entry None or the position of its own id in the dense ids.
+        static bool Verify(const SnapshotColumn& column, uint32_t entities);
+
+    protected:
+        uint32_t Insert(uint32_t id);
+        uint32_t Erase(uint32_t id);
+        void     Clear();
+        void     Swap(uint32_t a, uint32_t b);
+        uint32_t Pages() const;
+        void     Save(SnapshotWriter& writer) const;
+        void     Restore(const SnapshotColumn& column);
+        // Pages other lacks are reset rather than freed, so repeated copies into the same set reuse them.
+        void     CopyFrom(const SparseSet& other);
+
+    private:
+        uint32_t& Slot(uint32_t id);
+
+        std::pmr::vector<uint32_t*> m_Sparse;
+        std::pmr::vector<uint32_t>  m_Dense;
+        uint64_t                    m_Version = 0;
+    };
+    // Ticks of the last add and the last write of one component, compared against a system's last run by Added/Changed filters.
+    struct ComponentTicks
+    {
+        uint32_t Added   = 0;
+        uint32_t Changed = 0;
+    };
+    // Empty component types are tags: an entity holds one as its signature bit only, without pool, archetype column or ticks,
+    // so Added and Changed filters on a tag pass nothing. Every pointer handed out for a tag points to one shared instance.
+    template <typename ComponentType> inline constexpr bool IsTag = std::is_empty_v<ComponentType>;
+    template <typename ComponentType> ComponentType*        TagInstance();
+    // View<A, Optional<B>> visits the entities holding A and hands B over as a pointer, null where the entity has no B.
+    template <typename ComponentType> struct Optional
+    {
+    };
+    // One element of a view: the component it resolves to, what callbacks and structured bindings receive for it, whether
+    // entities must hold it to be visited and whether handing it out counts as a write. View<const T> only reads T.
+    template <typename Element> struct ViewElement
+    {
+        using Type                     = std::remove_const_t<Element>;
+        using Argument                 = Element&;
+        static constexpr bool Required = true;
+        static constexpr bool Writes   = !std::is_const_v<Element> && !IsTag<Type>;
+        static Argument       Pass(Type* component) { return *component; }
+    };
+    template <typename ComponentType> struct ViewElement<Optional<ComponentType>>
+    {
+        static_assert(!IsTag<ComponentType>, "Optional tags carry no data, test them with Entity::Has");
+        using Type                     = std::remove_const_t<ComponentType>;
+        using Argument                 = ComponentType*;
+        static constexpr bool Required = false;
+        static constexpr bool Writes   = !std::is_const_v<ComponentType>;
+        static Argument       Pass(Type* component) { return component; }
+    };
+    class IComponentArray : public SparseSet
     {
     public:
-        virtual ~IComponentArray()                               = default;
-        virtual void* AddComponent(uint32_t id, void* component) = 0;
-        virtual void* GetComponent(uint32_t id)                  = 0;
-        virtual void  RemoveComponent(uint32_t id)               = 0;
+        IComponentArray(std::pmr::memory_resource* resource);
+        virtual ~IComponentArray()                                              = default;
+        virtual void* AddComponent(uint32_t id, void* component, uint32_t tick) = 0;
+        virtual void* GetComponent(uint32_t id)                                 = 0;
+        virtual void  RemoveComponent(uint32_t id)                              = 0;
+        // Swaps the entities at positions a and b together with their components and ticks.
+        virtual void  Exchange(uint32_t a, uint32_t b)                          = 0;
+        // Moves the given entities, which must all be in the pool, to its front in the given order.
+        void          Reorder(const uint32_t* entities, uint32_t count);
+
+        ComponentTicks* Ticks(uint32_t id);
+        ComponentTicks* TicksAt(uint32_t index);
+
+    protected:
+        std::pmr::vector<ComponentTicks> m_Ticks;
     };
     template <typename ComponentType> class ComponentArray : public IComponentArray
     {
     public:
-        ComponentArray() = default;
+        ComponentArray(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
-        virtual void* AddComponent(uint32_t id, void* component);
+        virtual void* AddComponent(uint32_t id, void* component, uint32_t tick);
         virtual void* GetComponent(uint32_t id);
         virtual void  RemoveComponent(uint32_t id);
+        virtual void  Exchange(uint32_t a, uint32_t b);
+
+        ComponentType* Add(uint32_t id, const ComponentType& component, uint32_t tick);
+        ComponentType* Data();
+        void           Reserve(uint32_t count);
+        void           Clear();
+        // Copies the entities, ticks and components of other into this pool's buffers.
+        void           CopyFrom(const ComponentArray& other);
+        // Copies only the components written at or after since, for a pool holding the same entities in the same order.
+        void           CopyChanged(const ComponentArray& other, uint32_t since);
+
+        // Constructs the component from args at the end of the pool, or assigns it if the entity has one already.
+        template <typename... Args> ComponentType* Emplace(uint32_t id, uint32_t tick, Args&&... args);
+        // Assigns a single ComponentType argument directly, anything else through a temporary built from args.
+        template <typename... Args> static void Assign(ComponentType& target, Args&&... args);
+
+        // Writes the whole pool as one snapshot column and reads it back into an empty pool. Load returns false when the
+        // serialized stream of the column ran short.
+        void Save(SnapshotWriter& writer, const std::string& name, const Serializer<ComponentType>& serializer) const;
+        bool Load(const SnapshotColumn& column, const Serializer<ComponentType>& serializer);
 
     private:
-        std::unordered_map<uint32_t, uint32_t> m_EntityToIndex;
-        std::vector<ComponentType>             m_ComponentArray;
+        std::pmr::vector<ComponentType> m_ComponentArray;
     };
 
+    // The first 64 component ids live inline, so signatures only allocate once a program registers more component types.
+    // The overflow words take the allocator of the container holding the signature, so the per-entity signatures of a
+    // ComponentManager allocate from its resource.
     class Signature
     {
     public:
+        using allocator_type = std::pmr::polymorphic_allocator<uint64_t>;
+
+        Signature() = default;
+        explicit Signature(const allocator_type& allocator);
+        Signature(const Signature& other, const allocator_type& allocator);
+        Signature(Signature&& other, const allocator_type& allocator);
+        Signature(const Signature&)            = default;
+        Signature(Signature&&)                 = default;
+        Signature& operator=(const Signature&) = default;
+        Signature& operator=(Signature&&)      = default;
+
         bool   Get(uint64_t id) const;
         void   Set(uint64_t id, bool value);
         bool   Matches(const Signature& required) const;
-        size_t Size() const
+        bool   Intersects(const Signature& other) const;
+        bool   operator==(const Signature& other) const;
+        // Keeps only the bits also set in other.
+        void   Mask(const Signature& other);
+        size_t Hash() const;
+        size_t Size() const;
+
+        // Calls func(id) for every set bit in ascending order.
+        template <typename Func> void Each(Func&& func) const;
+
+    private:
+        size_t   Words() const;
+        uint64_t Word(size_t i) const;
+
+        uint64_t                   m_Inline = 0;
+        std::pmr::vector<uint64_t> m_Overflow;
+    };
+    struct SignatureHash
+    {
+        size_t operator()(const Signature& signature) const { return signature.Hash(); }
+    };
+    // Component-major copy of the signatures: one bitset over entity ids per component type, padded to whole blocks.
+    // Matching a signature ANDs the bitsets of its components a block of 256 entities at a time (one AVX2 operation per
+    // bitset where the compiler targets it), so views of tags and batch operations skip unmatched entities in bulk.
+    class SignatureMatrix
+    {
+    public:
+        static constexpr size_t BlockWords = 4;
+
+        SignatureMatrix(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+        void Set(uint32_t entity_id, uint32_t component_id, bool value);
+        // Overwrites the bitset of component_id with the one in other.
+        void CopyColumn(const SignatureMatrix& other, uint32_t component_id);
+        // The first entity in [entity_id, end) holding every component of a non-empty signature, or end.
+        uint32_t Next(const Signature& signature, uint32_t entity_id, uint32_t end) const;
+        // Calls func(entity_id) in ascending order for every entity in [begin, end) holding every component of a non-empty signature.
+        template <typename Func> void Each(const Signature& signature, uint32_t begin, uint32_t end, Func&& func) const;
+
+    private:
+        // Collects the bitsets of the signature's components, returns the number of words all of them cover.
+        size_t      Columns(const Signature& signature, std::vector<const uint64_t*>& columns) const;
+        static bool Intersect(const std::vector<const uint64_t*>& columns, size_t block, uint64_t* bits);
+
+        std::pmr::vector<std::pmr::vector<uint64_t>> m_Columns;
+    };
+
+    struct QueryStatistics
+    {
+        uint64_t Hits    = 0;  // views served from the cached entity list
+        uint64_t Checks  = 0;  // signature tests run while maintaining the list
+        uint64_t Inserts = 0;
+        uint64_t Erases  = 0;
+    };
+    // Persistent query: the set of entities matching a signature, kept up to date as signatures change.
+    class Query : public SparseSet
+    {
+    public:
+        Query(const Signature& signature, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+        const Signature&       GetSignature() const;
+        const QueryStatistics& Statistics() const;
+
+    private:
+        friend class ComponentManager;
+
+        void Update(uint32_t entity_id, const Signature& signature);
+
+        Signature       m_Signature;
+        QueryStatistics m_Statistics;
+    };
+    // Owning group: the entities holding all owned components sit at the front of every owned pool in the same order, so
+    // iterating them zips the dense arrays by index. Membership is kept by swapping entities over the group boundary as
+    // components are added and removed. A pool belongs to at most one group.
+    class OwningGroup
+    {
+    public:
+        OwningGroup(const Signature& signature, std::vector<IComponentArray*> pools);
+
+        uint32_t         Size() const;
+        const Signature& GetSignature() const;
+
+    private:
+        friend class ComponentManager;
+
+        bool Contains(uint32_t entity_id) const;
+        void Enter(uint32_t entity_id);
+        void Leave(uint32_t entity_id);
+        void Refresh(const std::pmr::vector<Signature>& signatures);
+
+        Signature                     m_Signature;
+        std::vector<IComponentArray*> m_Pools;
+        uint32_t                      m_Size = 0;
+    };
+
+    //*___ARCHETYPE_MANAGER___________________________________________________________________________________________________________________________________________________________________________________________
+
+    struct ComponentInfo
+    {
+        size_t Size                                 = 0;
+        size_t Alignment                            = 0;
+        void (*MoveConstruct)(void* dst, void* src) = nullptr;
+        void (*Destruct)(void* ptr)                 = nullptr;
+
+        template <typename ComponentType> static ComponentInfo Create();
+    };
+    class Archetype
+    {
+    public:
+        static constexpr size_t   ChunkSize = 16 * 1024;
+        static constexpr uint32_t None      = UINT32_MAX;
+
+        Archetype(const Signature& signature, const std::vector<std::pair<uint32_t, ComponentInfo>>& columns, std::pmr::memory_resource* resource);
+        ~Archetype();
+        Archetype(const Archetype&)            = delete;
+        Archetype& operator=(const Archetype&) = delete;
+
+        uint32_t                          Size() const;
+        uint32_t                          ChunkCapacity() const;
+        const Signature&                  GetSignature() const;
+        const std::pmr::vector<uint32_t>& Entities() const;
+        int32_t                           ColumnIndex(uint32_t component_id) const;
+        void*                             At(int32_t column, uint32_t row);
+        ComponentTicks*                   TicksAt(int32_t column, uint32_t row);
+
+    private:
+        friend class ArchetypeManager;
+
+        struct Column
         {
-            size_t size = 0;
-            for (size_t i = 0; i < 64 * m_Data.size(); ++i)
-            {
-                if (Get(i))
-                {
-                    ++size;
-                }
-            }
-            return size;
-        }
+            uint32_t      ComponentId;
+            ComponentInfo Info;
+            size_t        Offset;
+            size_t        TickOffset;
+        };
+
+        uint32_t Allocate(uint32_t entity_id);
+        uint32_t Erase(uint32_t row);
+        void     Swap(uint32_t a, uint32_t b, std::byte* scratch);
+        size_t   Layout(uint32_t capacity);
+
+        Signature                    m_Signature;
+        std::vector<Column>          m_Columns;
+        std::vector<int32_t>         m_ColumnIndex;
+        std::pmr::vector<std::byte*> m_Chunks;
+        std::pmr::vector<uint32_t>   m_Entities;
+        std::vector<uint32_t>        m_AddEdges;
+        std::vector<uint32_t>        m_RemoveEdges;
+        size_t                       m_ChunkBytes;
+        size_t                       m_ChunkAlignment;
+        size_t                       m_MaxComponentSize;
+        uint32_t                     m_ChunkCapacity;
+    };
+    class ArchetypeManager
+    {
+    public:
+        ArchetypeManager(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+        void                                             RegisterComponent(uint32_t component_id, const ComponentInfo& info);
+        template <typename ComponentType, typename... Args>
+        ComponentType*                                   Emplace(uint32_t entity_id, uint32_t component_id, uint32_t tick, Args&&... args);
+        void*                                            GetComponent(uint32_t entity_id, uint32_t component_id);
+        ComponentTicks*                                  GetTicks(uint32_t entity_id, uint32_t component_id);
+        void                                             RemoveComponent(uint32_t entity_id, uint32_t component_id);
+        void                                             Destroy(uint32_t entity_id);
+        template <typename... Components>
+        void Spawn(const std::vector<uint32_t>& ids, const Signature& signature, uint32_t tick, const Components&... components);
+        // Gives the entity a row in the archetype of signature, its components are left for the caller to construct.
+        void Place(uint32_t entity_id, const Signature& signature);
+        // Sorts the rows of every archetype holding the component by compare on it.
+        template <typename ComponentType, typename Compare> void Sort(uint32_t component_id, Compare& compare);
+
+        std::vector<Archetype*> Matching(const Signature& signature) const;
 
     private:
-        std::vector<uint64_t> m_Data;
+        struct Location
+        {
+            uint32_t ArchetypeIndex = Archetype::None;
+            uint32_t Row            = 0;
+        };
+
+        uint32_t FindOrCreate(const Signature& signature);
+        uint32_t AddEdge(uint32_t archetype, uint32_t component_id);
+        uint32_t RemoveEdge(uint32_t archetype, uint32_t component_id);
+        uint32_t Move(uint32_t entity_id, uint32_t target);
+        void     ValidateLocation(uint32_t entity_id);
+
+        std::vector<std::unique_ptr<Archetype>>                m_Archetypes;
+        std::unordered_map<Signature, uint32_t, SignatureHash> m_ArchetypeIndex;
+        std::vector<ComponentInfo>                             m_ComponentInfos;
+        std::pmr::vector<Location>                             m_Locations;
     };
+
+    //*___COMPONENT_MANAGER___________________________________________________________________________________________________________________________________________________________________________________________
+
     class ComponentManager
     {
     public:
-        ComponentManager() = default;
+        ComponentManager(StorageMode mode = StorageMode::Pooled, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
-        template <typename ComponentType> ComponentType* AddComponent(uint32_t entity_id, const ComponentType& component);
-        template <typename ComponentType> ComponentType* GetComponent(uint32_t entity_id);
-        template <typename ComponentType> void           RemoveComponent(uint32_t entity_id);
-        template <typename ComponentType> bool           HasComponent(uint32_t entity_id) const;
-        void                                             Destroy(uint32_t entity_id);
+        template <typename ComponentType, typename... Args> ComponentType* EmplaceComponent(uint32_t entity_id, Args&&... args);
+        template <typename ComponentType, typename... Args> ComponentType* ReplaceComponent(uint32_t entity_id, Args&&... args);
+        template <typename ComponentType> ComponentType*                   GetComponent(uint32_t entity_id);
+        template <typename ComponentType> void                             RemoveComponent(uint32_t entity_id);
+        template <typename ComponentType> bool                             HasComponent(uint32_t entity_id) const;
+        template <typename ComponentType> void                             Reserve(uint32_t count);
+        void                                                               Destroy(uint32_t entity_id);
+
+        // Ids of the entities holding all of Components, RemoveAll takes ComponentType from every entity and returns how many.
+        template <typename... Components> std::vector<uint32_t> Collect() const;
+        // Calls func(component_id) for every component the entity holds, tags included.
+        template <typename Func> void EachComponent(uint32_t entity_id, Func&& func) const;
+        template <typename ComponentType> uint32_t              RemoveAll();
 
-        template <typename... Components> Signature BuildSignature();
-        bool                                        Matches(uint32_t id, const Signature& signature) const;
+        // Like GetComponent, but the read does not count as a write.
+        template <typename ComponentType> const ComponentType* ReadComponent(uint32_t entity_id);
+
+        // Bulk paths: signatures and pools are grown once for the whole batch. Source is called once per id for the next value.
+        template <typename ComponentType, typename Source> void Insert(const uint32_t* ids, uint32_t count, Source&& source);
+        template <typename... Components> void                  Spawn(const std::vector<uint32_t>& ids, const Components&... components);
+
+        // Orders the Hierarchy pool by depth and the pools of Components after it. Archetype rows keep their order.
+        template <typename... Components> void SortHierarchy();
+        template <typename ComponentType, typename Compare> void Sort(Compare& compare);
+        template <typename Leader, typename Follower> void       Sort();
+
+        template <typename... Components> static const Signature& BuildSignature();
+        bool                                                      Matches(uint32_t id, const Signature& signature) const;
+        StorageMode                                               Mode() const;
+
+        // Writes are stamped with the current tick. AdvanceTick ends it and returns it, later writes compare greater.
+        uint32_t        Tick() const;
+        uint32_t        AdvanceTick();
+        ComponentTicks* Ticks(uint32_t entity_id, uint32_t component_id);
+
+        // Registration and lookup share m_QueryMutex, so systems may cache queries while others build views.
+        const Query& RegisterQuery(const Signature& signature);
+        Query*       FindQuery(const Signature& signature);
+#ifdef ECS_PROFILE
+        // Counts the views of a signature built without a cached query.
+        uint64_t QueryMisses(const Signature& signature) const;
+#endif
+
+        // Returns nullptr in archetype storage or when a pool of Components already belongs to another group.
+        template <typename... Components> const OwningGroup* RegisterGroup();
+        const OwningGroup*                                   FindGroup(const Signature& signature) const;
+
+        template <typename ComponentType> void RegisterSnapshot(const std::string& name, const Serializer<ComponentType>& serializer);
+        void                                   SaveSnapshot(SnapshotWriter& writer);
+        bool                                   LoadSnapshot(const std::vector<SnapshotColumn>& columns, uint32_t entities, uint32_t tick);
+
+        // Replaces the signatures and pools of this pooled manager with those of Components in source, which may use either
+        // mode. Buffers left from a previous copy of the same types are reused. Repeated copies from one pooled source only
+        // copy the values written since the last one into pools and signatures whose entities have not changed since.
+        template <typename... Components> void CopyFrom(const ComponentManager& source);
 
     private:
-        template <typename... Components> typename std::enable_if<sizeof...(Components) == 0, bool>::type ValidateComponents() const;
-        template <typename T, typename... Components> bool                                                ValidateComponents() const;
+        template <typename... Components> friend class StorageView;
+
+        // A source and its version at the last copy, next to the version the copy left here. While both still match,
+        // the copy holds the same entities in the same order.
+        struct Mirror
+        {
+            const void* Source        = nullptr;
+            uint64_t    SourceVersion = 0;
+            uint64_t    Version       = 0;
+
+            bool Matches(const void* source, uint64_t source_version, uint64_t version) const
+            {
+                return Source == source && SourceVersion == source_version && Version == version;
+            }
+        };
+        struct SnapshotType
+        {
+            std::string                                Name;
+            uint32_t                                   ComponentId;
+            bool                                       Raw;
+            uint32_t                                   Size;
+            std::function<void(SnapshotWriter&)>       Save;
+            std::function<bool(const SnapshotColumn&)> Load;
+        };
 
-        template <typename... Components> typename std::enable_if<sizeof...(Components) == 0, Signature>::type GetSignature() const;
-        template <typename T, typename... Components> Signature                                                GetSignature() const;
+        void                                                             ValidateSignature(uint32_t entity_id);
+        void                                                             SetSignature(uint32_t entity_id, uint32_t component_id, bool value);
+        void                                                             UpdateQueries(uint32_t entity_id, uint32_t component_id);
+        template <typename ComponentType> uint32_t                       RegisterComponent();
+        template <typename ComponentType> ComponentArray<ComponentType>* GetComponentArray() const;
+        template <typename ComponentType> void                           Follow(const std::vector<uint32_t>& order);
+        template <typename ComponentType> void                           CopyType(const ComponentManager& source, bool signatures, uint32_t since);
+        OwningGroup*                                                     GroupOf(uint32_t component_id) const;
+        bool                                                             EnterGroup(uint32_t entity_id, uint32_t component_id);
+        void                                                             LeaveGroup(uint32_t entity_id, uint32_t component_id);
 
-        void                                   ValidateSignature(uint32_t entity_id);
-        template <typename ComponentType> void RegisterComponent();
+        std::vector<std::unique_ptr<IComponentArray>> m_ComponentArrays;
+        std::vector<ComponentInfo>                    m_ComponentInfos;
+        std::pmr::vector<Signature>                   m_Signatures;
+        SignatureMatrix                               m_Matrix;
+        ArchetypeManager                              m_ArchetypeManager;
+        StorageMode                                   m_Mode;
+        std::pmr::memory_resource*                    m_Resource;
+        std::atomic<uint32_t>                         m_Tick = 1;
+        // Counts changes to the signatures, like SparseSet::Version does for a pool.
+        uint64_t                                      m_Version = 0;
+        Mirror                                        m_Mirror;
+        std::vector<Mirror>                           m_PoolMirrors;
 
-        std::unordered_map<std::type_index, std::shared_ptr<IComponentArray>> m_ComponentArrays;
-        std::unordered_map<std::type_index, uint32_t>                         m_ComponentId;
-        std::vector<Signature>                                                m_Signatures;
+        std::unordered_map<Signature, std::unique_ptr<Query>, SignatureHash> m_Queries;
+#ifdef ECS_PROFILE
+        std::unordered_map<Signature, uint64_t, SignatureHash>               m_QueryMisses;
+#endif
+        std::vector<std::vector<Query*>>                                     m_ComponentQueries;
+        mutable std::mutex                                                   m_QueryMutex;
+        std::vector<SnapshotType>                                            m_SnapshotTypes;
+        std::vector<std::unique_ptr<OwningGroup>>                            m_Groups;
+        std::vector<OwningGroup*>                                            m_ComponentGroups;
     };
 
     //*___ENTITY_MANAGER___________________________________________________________________________________________________________________________________________________________________________________________
 
+    // Every slot has a full 32-bit generation, which wraps around skipping 0, and a link to the next free id once it is destroyed.
+    // The free list is a FIFO queue threaded through those links, so a destroyed id rests behind every other free id before it is
+    // handed out again and a stale handle has to survive 2^32 - 1 reuses of its slot to alias a live entity.
     class EntityManager
     {
     public:
-        EntityManager() = default;
+        static constexpr uint32_t Null = UINT32_MAX;
+
+        EntityManager(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
         std::pair<uint32_t, uint32_t> CreateEntity();
+        void                          CreateEntities(uint32_t count, std::vector<uint32_t>& ids);
         void                          Destroy(uint32_t id);
         bool                          Valid(uint32_t id, uint32_t gen) const;
+        bool                          Alive(uint32_t id) const;
 
     private:
+        friend class Storage;
         template <typename... Components> friend class StorageView;
 
         uint32_t NextEntity(uint32_t id) const;
         uint32_t Generation(uint32_t id) const;
         uint32_t BeginEntity() const;
         uint32_t EndEntity() const;
+        uint32_t FindAlive(uint32_t id) const;
+        uint32_t Revive();
+        void     SetAlive(uint32_t id, bool alive);
+        void     Save(SnapshotWriter& writer) const;
+        void     Restore(const uint32_t* generations, const uint32_t* next, const uint64_t* alive, uint32_t count, uint32_t free_head, uint32_t free_tail);
+
+        // Checks saved slots before Restore trusts them: no liveness bits past count, a free list of dead ids ending at the tail.
+        static bool Verify(const uint32_t* next, const uint64_t* alive, uint32_t count, uint32_t free_head, uint32_t free_tail);
+
+        std::pmr::vector<uint32_t> m_Generations;
+        std::pmr::vector<uint32_t> m_Next;
+        std::pmr::vector<uint64_t> m_Alive;
+        uint32_t                   m_FreeHead = Null;
+        uint32_t                   m_FreeTail = Null;
+    };
+
+    //*___SNAPSHOT___________________________________________________________________________________________________________________________________________________________________________________________
+
+    // A snapshot is the header, the entity generations, free links and liveness bitmap, then one column per registered component type:
+    // its header and name, the dense entity ids, the sparse pages, the ticks and the component data. Arrays start on
+    // Alignment boundaries, so the columns of a mapped file are copied into the pools with one bulk copy each.
+    // Trivially copyable components are stored raw, others as the byte stream of their Serializer.
+    struct SnapshotHeader
+    {
+        uint32_t Magic;
+        uint32_t Version;
+        uint32_t Tick;
+        uint32_t Entities;
+        uint32_t FreeHead;
+        uint32_t FreeTail;
+    };
+    struct SnapshotColumnHeader
+    {
+        uint32_t NameLength;
+        uint32_t Raw;
+        uint32_t Size;
+        uint32_t Count;
+        uint32_t Pages;
+    };
+    // One column inside a mapped snapshot, the pointers are valid while its reader lives.
+    struct SnapshotColumn
+    {
+        std::string           Name;
+        bool                  Raw;
+        uint32_t              Size;
+        uint32_t              Count;
+        uint32_t              Pages;
+        const uint32_t*       Entities;
+        const uint32_t*       PageIndices;
+        const uint32_t*       PageData;
+        const ComponentTicks* Ticks;
+        const std::byte*      Data;
+        size_t                Bytes;
+    };
+    class SnapshotWriter
+    {
+    public:
+        static constexpr uint32_t Magic     = 0x53534345;  // "ECSS"
+        static constexpr uint32_t Version   = 2;
+        static constexpr size_t   Alignment = 64;
+
+        void                       Write(const void* data, size_t size);
+        template <typename T> void Write(const T& value);
+        void                       Align();
+        size_t                     Offset() const;
+        template <typename T> void Patch(size_t offset, const T& value);
+        bool                       WriteFile(const std::string& path) const;
+
+    private:
+        std::string m_Buffer;
+    };
+    // Maps a snapshot file read-only (or reads it into one aligned buffer where mmap is unavailable), or wraps a byte range.
+    // Reads past the end return nullptr and leave the reader failed.
+    class SnapshotReader
+    {
+    public:
+        SnapshotReader(const std::string& path);
+        SnapshotReader(const std::byte* data, size_t size);
+        ~SnapshotReader();
+        SnapshotReader(const SnapshotReader&)            = delete;
+        SnapshotReader& operator=(const SnapshotReader&) = delete;
+
+        bool                             Good() const;
+        const std::byte*                 Read(size_t size);
+        template <typename T> T          Read();
+        template <typename T> const T*   ReadArray(size_t count);
+        void                             Align();
+        bool                             ReadColumn(SnapshotColumn& column);
+
+    private:
+        const std::byte* m_Data   = nullptr;
+        size_t           m_Size   = 0;
+        size_t           m_Offset = 0;
+        bool             m_Good   = false;
+        bool             m_Owned  = false;
+    };
+    // Save appends one component to the writer, Load reads one back in the same order.
+    template <typename ComponentType> struct Serializer
+    {
+        std::function<void(const ComponentType&, SnapshotWriter&)> Save;
+        std::function<ComponentType(SnapshotReader&)>              Load;
+    };
+
+    //*___THREAD_POOL___________________________________________________________________________________________________________________________________________________________________________________________
+
+    class TaskGroup
+    {
+    public:
+        bool Done() const;
+
+    private:
+        friend class ThreadPool;
+        std::atomic<uint32_t> m_Remaining = 0;
+    };
+    // Work-stealing pool: every worker owns a deque, pops its own tasks LIFO and steals FIFO from the others.
+    // Threads waiting on a TaskGroup run queued tasks instead of blocking, so tasks may submit and wait on nested groups.
+    // With nothing left to run they sleep next to the idle workers until the group finishes or more work is submitted.
+    class ThreadPool
+    {
+    public:
+        ThreadPool(uint32_t workers = std::max(1u, std::thread::hardware_concurrency()) - 1);
+        ~ThreadPool();
+        ThreadPool(const ThreadPool&)            = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        uint32_t Workers() const;
+        void     Submit(TaskGroup& group, std::function<void()> task);
+        void     Wait(TaskGroup& group);
+
+        static ThreadPool& Shared();
+
+    private:
+        struct Task
+        {
+            std::function<void()> Function;
+            TaskGroup*            Group;
+        };
+        struct Queue
+        {
+            std::mutex       Mutex;
+            std::deque<Task> Tasks;
+        };
+
+        bool     TryRun(uint32_t queue);
+        void     WorkerLoop(uint32_t queue);
+        uint32_t CurrentQueue() const;
+
+        std::vector<std::unique_ptr<Queue>> m_Queues;
+        std::vector<std::thread>            m_Threads;
+        std::atomic<uint32_t>               m_Pending = 0;
+        std::atomic<bool>                   m_Stop    = false;
+        std::mutex                          m_SleepMutex;
+        std::condition_variable             m_Wake;
+
+        static inline thread_local ThreadPool* t_Pool  = nullptr;
+        static inline thread_local uint32_t    t_Queue = 0;
+    };
+
+    //*___PROFILER___________________________________________________________________________________________________________________________________________________________________________________________
+
+#ifdef ECS_PROFILE
+    // Samples go to the system running on the current thread. ParallelEach tasks adopt the sample of the thread that
+    // started them, so work stolen by a thread busy with another system is still attributed correctly.
+    class Profiler
+    {
+    public:
+        static constexpr uint32_t Window    = 128;
+        static constexpr size_t   MaxEvents = 1 << 20;
+
+        struct Counters
+        {
+            std::atomic<uint64_t> Visited = 0;
+            std::atomic<uint64_t> Changes = 0;
+        };
+        // Times are in microseconds, counts are averages over the last Window updates.
+        struct Statistics
+        {
+            std::string Name;
+            uint64_t    Updates;
+            double      Min;
+            double      Avg;
+            double      P99;
+            double      Visited;
+            double      Changes;
+        };
+        class Adopt
+        {
+        public:
+            Adopt(Counters* counters);
+            ~Adopt();
+
+        private:
+            Counters* m_Previous;
+        };
+
+        Profiler();
 
-        std::vector<uint32_t> m_Generations;
-        std::vector<bool>     m_States;
-        std::queue<uint32_t>  m_AvailableEntities;
+        std::vector<Statistics> Stats() const;
+        bool                    WriteTrace(const std::string& path) const;
+        void                    Clear();
+
+        static Counters* Current();
+        static void      CountVisits(uint64_t count);
+        static void      CountChanges(uint64_t count);
+
+    private:
+        friend class SystemManager;
+
+        struct Sample
+        {
+            uint64_t Duration;
+            uint64_t Visited;
+            uint64_t Changes;
+        };
+        struct Event
+        {
+            uint32_t System;
+            uint32_t Thread;
+            uint64_t Start;
+            Sample   Data;
+        };
+        struct History
+        {
+            std::string                 Name;
+            uint64_t                    Updates = 0;
+            std::array<Sample, Window> Samples;
+        };
+
+        void     Run(uint32_t system, System& instance, float dt);
+        uint64_t Now() const;
+
+        std::vector<History>                  m_Systems;
+        std::vector<Event>                    m_Events;
+        std::chrono::steady_clock::time_point m_Epoch;
+        mutable std::mutex                    m_Mutex;
+
+        static inline std::atomic<uint32_t>  s_NextThread = 0;
+        static inline thread_local uint32_t  t_Thread     = UINT32_MAX;
+        static inline thread_local Counters* t_Current    = nullptr;
+    };
+#else
+    // Without ECS_PROFILE the hooks are empty and vanish once inlined.
+    class Profiler
+    {
+    public:
+        struct Counters
+        {
+        };
+        class Adopt
+        {
+        public:
+            Adopt(Counters*) {}
+        };
+
+        static Counters* Current() { return nullptr; }
+        static void      CountVisits(uint64_t) {}
+        static void      CountChanges(uint64_t) {}
     };
+#endif
 
     //*___SYSTEM_MANAGER___________________________________________________________________________________________________________________________________________________________________________________________
 
+    enum class ExecutionMode
+    {
+        Serial,
+        Parallel
+    };
     class System
     {
     public:
@@ -132,26 +906,72 @@ namespace ECS
 
     protected:
         template <typename... Components> StorageView<Components...> View();
+        CommandBuffer&                                               Commands();
+
+        // Resources are not tracked by the scheduler on their own, systems sharing one declare it with Reads or Writes.
+        template <typename ResourceType> ResourceType* GetResource();
+
+        // Declared component access lets the scheduler run non-conflicting systems side by side.
+        // A system that declares nothing is treated as touching everything.
+        template <typename... Components> void Reads();
+        template <typename... Components> void Writes();
 
     private:
         friend class SystemManager;
         void Bind(Storage* storage);
+        bool Conflicts(const System& other) const;
 
-        Storage* m_Storage;
+        Storage*  m_Storage;
+        Signature m_Reads;
+        Signature m_Writes;
+        bool      m_Declared = false;
+        uint32_t  m_LastRun  = 0;
     };
     class SystemManager
     {
     public:
         SystemManager(Storage* storage);
         void                                            Update(float dt);
-        template <typename Before, typename After> void AddDependency();
+        // Returns false and ignores the dependency when it would close a cycle.
+        template <typename Before, typename After> bool AddDependency();
         template <typename SystemType> void             RegisterSystem();
+        void                                            SetExecutionMode(ExecutionMode mode, ThreadPool* pool = nullptr);
+#ifdef ECS_PROFILE
+        Profiler& GetProfiler();
+#endif
 
     private:
-        std::vector<std::shared_ptr<System>>          m_Systems;
-        std::unordered_map<std::type_index, uint32_t> m_SystemId;
-        std::vector<std::vector<uint32_t>>            m_DependencyGraph;
-        Storage*                                      m_Storage;
+        void BuildGraph();
+        void RunParallel(float dt);
+        void RunSystem(uint32_t index, float dt);
+
+        std::vector<std::shared_ptr<System>>       m_Systems;
+        std::vector<uint32_t>                      m_SystemId;
+        std::vector<std::pair<uint32_t, uint32_t>> m_Dependencies;
+        std::vector<std::vector<uint32_t>>         m_DependencyGraph;
+        std::vector<uint32_t>                      m_InDegree;
+        std::vector<uint32_t>                      m_Order;
+        std::unique_ptr<std::atomic<uint32_t>[]>   m_Remaining;
+        bool                                       m_Dirty;
+        ExecutionMode                              m_Mode;
+        ThreadPool*                                m_ThreadPool;
+        Storage*                                   m_Storage;
+#ifdef ECS_PROFILE
+        Profiler m_Profiler;
+#endif
+    };
+
+    //*___HIERARCHY___________________________________________________________________________________________________________________________________________________________________________________________
+
+    // Links of an entity in the scene hierarchy, added and kept consistent by Entity::SetParent. The links are entity ids,
+    // Null ends a list. Destroying an entity or removing its Hierarchy detaches it, its children become roots.
+    struct Hierarchy
+    {
+        uint32_t Parent      = EntityManager::Null;
+        uint32_t FirstChild  = EntityManager::Null;
+        uint32_t NextSibling = EntityManager::Null;
+        uint32_t PrevSibling = EntityManager::Null;
+        uint32_t Depth       = 0;
     };
 
     //*___ENTITY____________________________________________________________________________________________________________________________________________________________________________________________________
@@ -164,10 +984,24 @@ namespace ECS
         bool Valid() const;
         void Destroy();
 
-        template <typename ComponentType> ComponentType* Add(ComponentType component = ComponentType());
-        template <typename ComponentType> ComponentType* Get();
-        template <typename ComponentType> bool           Has() const;
-        template <typename ComponentType> void           Remove();
+        // Add moves its argument into the pool, Emplace constructs the component there from args. Both assign over an
+        // existing component, Replace only does that and returns nullptr if there is none.
+        template <typename ComponentType> ComponentType*                   Add(ComponentType component = ComponentType());
+        template <typename ComponentType, typename... Args> ComponentType* Emplace(Args&&... args);
+        template <typename ComponentType, typename... Args> ComponentType* Replace(Args&&... args);
+        template <typename ComponentType> ComponentType*                   Get();
+        template <typename ComponentType> bool                             Has() const;
+        template <typename ComponentType> void                             Remove();
+
+        // Calls func on the component and marks it changed. Get<T> marks it changed as well, Get<const T> only reads.
+        template <typename ComponentType, typename Func> bool Patch(Func func);
+        template <typename ComponentType> bool                MarkChanged();
+
+        // Passing an invalid entity detaches this one. Making an entity its own ancestor fails.
+        bool   SetParent(const Entity& parent);
+        Entity Parent() const;
+        Entity FirstChild() const;
+        Entity NextSibling() const;
 
         bool operator==(const Entity& other) const;
         bool operator!=(const Entity& other) const;
@@ -176,18 +1010,64 @@ namespace ECS
         template <typename... Components> friend class StorageView;
         friend struct std::hash<Entity>;
         friend class Storage;
+        friend class CommandBuffer;
 
         uint32_t m_ID;
         uint32_t m_Gen;
         Storage* m_Storage;
     };
 
+    //*___OBSERVER__________________________________________________________________________________________________________________________________________________________________________________________
+
+    enum class Lifecycle : uint8_t
+    {
+        Add,
+        Remove,
+        Destroy
+    };
+    // Per component type observers of adds, removes and destroys. Events are appended to a queue per observed type as they
+    // happen, which costs a lookup and a push, and delivered later in batches: consecutive events of one kind reach each
+    // callback as one span of entities, so the order of events is kept. Unobserved types only pay the lookup.
+    class ObserverManager
+    {
+    public:
+        using Callback = std::function<void(std::span<const Entity>)>;
+
+        void Observe(Lifecycle kind, uint32_t component_id, Callback callback);
+        bool Active() const;
+        bool Observed(uint32_t component_id) const;
+        void Record(Lifecycle kind, uint32_t component_id, const Entity& entity);
+        void Deliver();
+
+    private:
+        struct Channel
+        {
+            std::array<std::vector<Callback>, 3> Callbacks;
+            std::vector<Entity>                  Entities;
+            std::vector<Lifecycle>               Kinds;
+            // The batch being delivered, events recorded by callbacks meanwhile wait for the next delivery.
+            std::vector<Entity>                  Delivering;
+            std::vector<Lifecycle>               DeliveringKinds;
+        };
+        struct Pending
+        {
+            Lifecycle Kind;
+            uint32_t  ComponentId;
+            Callback  Function;
+        };
+
+        std::vector<std::unique_ptr<Channel>> m_Channels;
+        std::vector<Pending>                  m_Pending;
+        bool                                  m_Delivering = false;
+    };
+
     //*___STORAGE___________________________________________________________________________________________________________________________________________________________________________________________
 
     class Storage
     {
     public:
-        Storage();
+        // Pools, chunks, signatures and entity slots allocate from resource, which must outlive the Storage.
+        Storage(StorageMode mode = StorageMode::Pooled, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
         ~Storage()                         = default;
         Storage(const Storage&)            = delete;
         Storage(Storage&&)                 = delete;
@@ -197,24 +1077,196 @@ namespace ECS
         Entity                                                       CreateEntity();
         template <typename... Components> StorageView<Components...> View();
 
-        template <typename SystemType> void RegisterSystem();
-        void                                UpdateSystems(float dt);
+        // Creates count entities holding copies of the given components, ids, signatures and pools are reserved up front.
+        template <typename... Components> std::vector<Entity>                       CreateEntities(uint32_t count, const Components&... components);
+        template <typename ComponentType, typename EntityIt, typename ValueIt> void Insert(EntityIt first, EntityIt last, ValueIt values);
+
+        // Batch forms of Destroy and Remove, both return the number of entities affected.
+        template <typename... Components> uint32_t DestroyAll();
+        template <typename ComponentType> uint32_t RemoveAll();
+
+        template <typename... Components> const Query& CacheQuery();
+#ifdef ECS_PROFILE
+        template <typename... Components> uint64_t QueryMisses() const;
+#endif
+
+        // Orders the Hierarchy pool by depth and the pools of Components to follow it, so a View<Hierarchy, Components...>
+        // visits parents before their children in one pass over the pools. Views served by a cached query keep the order
+        // of the query, archetype storage keeps its row order.
+        template <typename... Components> void SortHierarchy();
+
+        // Packs the entities holding all of Components at the front of their pools, views over exactly these components
+        // then iterate without lookups. Pooled storage only: archetype columns are packed already, there it returns nullptr.
+        // Pools owned by a group are skipped by SortHierarchy.
+        template <typename... Components> const OwningGroup* Group();
+
+        // Sorts the pool of ComponentType in place by compare(const ComponentType&, const ComponentType&), in archetype
+        // storage the rows of every archetype holding it. Group members stay in front of their pools, sorted among themselves.
+        template <typename ComponentType, typename Compare> void Sort(Compare compare);
+        // Moves the entities Follower shares with Leader to the front of its pool, in the order of Leader's pool. Archetype
+        // storage keeps both in the same rows already. Pools owned by a group are left alone.
+        template <typename Leader, typename Follower> void Sort();
+
+        template <typename SystemType> void             RegisterSystem();
+        // Returns false and ignores the dependency when it would close a cycle.
+        template <typename Before, typename After> bool AddSystemDependency();
+        void                                            SetExecutionMode(ExecutionMode mode, ThreadPool* pool = nullptr);
+        void                                            UpdateSystems(float dt);
+#ifdef ECS_PROFILE
+        Profiler& GetProfiler();
+#endif
+
+        CommandBuffer& Commands();
+        void           FlushCommands();
+
+        // Observers get the entities whose ComponentType was added (not assigned over), removed, or which were destroyed
+        // holding it. Events are delivered in batches by FlushEvents, which UpdateSystems calls after the commands are played
+        // back, in the order they happened. Destroyed entities arrive as stale handles, removed ones may be gone as well by
+        // then. Loading a snapshot raises no events. Observers registered by a callback take effect once the flush is done.
+        template <typename ComponentType> void OnAdd(ObserverManager::Callback callback);
+        template <typename ComponentType> void OnRemove(ObserverManager::Callback callback);
+        template <typename ComponentType> void OnDestroy(ObserverManager::Callback callback);
+        void                                   FlushEvents();
+
+        // One instance per type owned by the Storage, reached by index. SetResource replaces the previous instance, pointers
+        // to it then dangle. GetResource returns nullptr while none is set.
+        template <typename ResourceType, typename... Args> ResourceType* SetResource(Args&&... args);
+        template <typename ResourceType> ResourceType*                   GetResource();
+        template <typename ResourceType> void                            RemoveResource();
+
+        uint32_t Tick() const;
+        uint32_t AdvanceTick();
+
+        // Snapshots hold the entities and the component types registered under a name that is stable across runs.
+        // Trivially copyable types are stored as raw columns, other types need a serializer. Loading needs a Storage
+        // without entities, columns of unregistered names are skipped. Either mode loads snapshots saved by the other,
+        // but only pooled storage takes raw columns with one copy per array.
+        template <typename ComponentType> void RegisterSnapshot(const std::string& name);
+        template <typename ComponentType> void RegisterSnapshot(const std::string& name, Serializer<ComponentType> serializer);
+        bool                                   SaveSnapshot(const std::string& path);
+        bool                                   LoadSnapshot(const std::string& path);
 
     private:
         template <typename... Components> friend class StorageView;
+        template <typename... Components> friend class FrameBuffer;
         friend class Entity;
+        friend class CommandBuffer;
+
+        // Makes frame, a pooled Storage, hold this Storage's entity slots and tick with the signature bits and pools of
+        // Components only.
+        template <typename... Components> void CopyTo(Storage& frame) const;
+
+        bool   Valid(uint32_t id, uint32_t gen) const;
+        void   Destroy(uint32_t id, uint32_t gen);
+        Entity MakeEntity(uint32_t id, uint32_t gen);
+        // Records the event for an observed type, entities are taken with their current generation.
+        void   Notify(Lifecycle kind, uint32_t component_id, uint32_t id);
+
+        template <typename ComponentType, typename... Args> ComponentType* EmplaceComponent(uint32_t id, uint32_t gen, Args&&... args);
+        template <typename ComponentType, typename... Args> ComponentType* ReplaceComponent(uint32_t id, uint32_t gen, Args&&... args);
+        template <typename ComponentType> ComponentType*                   GetComponent(uint32_t id, uint32_t gen);
+        template <typename ComponentType> bool                             HasComponent(uint32_t id, uint32_t gen) const;
+        template <typename ComponentType> void                             RemoveComponent(uint32_t id, uint32_t gen);
+        template <typename ComponentType, typename Func> bool              PatchComponent(uint32_t id, uint32_t gen, Func& func);
+        template <typename ComponentType> bool                             MarkChanged(uint32_t id, uint32_t gen);
+
+        bool       SetParent(uint32_t id, uint32_t gen, const Entity& parent);
+        Entity     Related(uint32_t id, uint32_t gen, uint32_t Hierarchy::*link);
+        Hierarchy& Node(uint32_t id);
+        void       Detach(uint32_t id);
+        void       Unlink(uint32_t id);
+        void       UpdateDepth(uint32_t id, uint32_t depth);
+
+        struct CommandCache
+        {
+            const Storage* Owner;
+            uint64_t       Serial;
+            CommandBuffer* Buffer;
+        };
+
+        EntityManager                                                           m_EntityManager;
+        ComponentManager                                                        m_ComponentManager;
+        SystemManager                                                           m_SystemManager;
+        ObserverManager                                                         m_ObserverManager;
+        std::vector<std::pair<std::thread::id, std::unique_ptr<CommandBuffer>>> m_CommandBuffers;
+        std::mutex                                                              m_CommandMutex;
+        uint64_t                                                                m_Serial;
+        std::vector<std::shared_ptr<void>>                                      m_Resources;
+
+        static inline std::atomic<uint64_t>     s_NextSerial = 1;
+        static inline thread_local CommandCache t_CommandCache;
+    };
+
+    //*___COMMAND_BUFFER___________________________________________________________________________________________________________________________________________________________________________________________
+
+    // Records structural changes for later playback by Storage::FlushCommands (called by UpdateSystems after all systems ran).
+    // Playback is batched: entities are created first, then for every component type in id order the adds sorted by entity
+    // and the removes sorted by entity, then the destroys. Within one buffer an Add and a Remove of the same component on
+    // the same entity therefore end with the component removed, whatever order they were recorded in.
+    class CommandBuffer
+    {
+    public:
+        CommandBuffer() = default;
+
+        // The returned entity is a placeholder that is only meaningful to commands recorded in this buffer.
+        Entity                                 Create();
+        template <typename ComponentType> void Add(const Entity& entity, ComponentType component = ComponentType());
+        template <typename ComponentType> void Remove(const Entity& entity);
+        void                                   Destroy(const Entity& entity);
+
+        bool Empty() const;
+        void Clear();
+
+    private:
+        friend class Storage;
+        static constexpr uint32_t Placeholder = UINT32_MAX;
+
+        struct Target
+        {
+            uint32_t ID;
+            uint32_t Gen;
+        };
+        using Created = std::vector<std::pair<uint32_t, uint32_t>>;
+
+        class IBucket
+        {
+        public:
+            virtual ~IBucket()                                                  = default;
+            virtual uint32_t Adds() const                                       = 0;
+            virtual void     Reserve(Storage& storage, uint32_t count)          = 0;
+            virtual void     Playback(Storage& storage, const Created& created) = 0;
+            virtual void     Clear()                                            = 0;
+        };
+        template <typename ComponentType> class Bucket : public IBucket
+        {
+        public:
+            virtual uint32_t Adds() const override;
+            virtual void     Reserve(Storage& storage, uint32_t count) override;
+            virtual void     Playback(Storage& storage, const Created& created) override;
+            virtual void     Clear() override;
+
+            std::vector<std::pair<Target, ComponentType>> m_Adds;
+            std::vector<Target>                           m_Removes;
+        };
 
-        bool Valid(uint32_t id, uint32_t gen) const;
-        void Destroy(uint32_t id, uint32_t gen);
+        static void                                              Resolve(Target& target, const Created& created);
+        template <typename ComponentType> Bucket<ComponentType>& GetBucket();
+
+        uint32_t                              m_Commands = 0;
+        uint32_t                              m_Creates  = 0;
+        std::vector<std::unique_ptr<IBucket>> m_Buckets;
+        std::vector<Target>                   m_Destroys;
+    };
+    // Dereferenced view iterator: usable as an Entity, or unpacked as auto [entity, a, b] into component references.
+    template <typename... Components> class ViewEntry : public Entity
+    {
+    public:
+        ViewEntry(const Entity& entity, typename ViewElement<Components>::Type*... components);
 
-        template <typename ComponentType> ComponentType* AddComponent(uint32_t id, uint32_t gen, const ComponentType& component);
-        template <typename ComponentType> ComponentType* GetComponent(uint32_t id, uint32_t gen);
-        template <typename ComponentType> bool           HasComponent(uint32_t id, uint32_t gen) const;
-        template <typename ComponentType> void           RemoveComponent(uint32_t id, uint32_t gen);
+        template <size_t I> decltype(auto) get() const;
 
-        EntityManager    m_EntityManager;
-        ComponentManager m_ComponentManager;
-        SystemManager    m_SystemManager;
+    private:
+        std::tuple<typename ViewElement<Components>::Type*...> m_Components;
     };
     template <typename... Components> class StorageView
     {
@@ -223,37 +1275,152 @@ namespace ECS
         {
         public:
             Iterator(uint32_t id, StorageView* v);
+            Iterator(uint32_t archetype, uint32_t row, StorageView* v);
 
-            bool      operator==(const Iterator& other) const;
-            bool      operator!=(const Iterator& other) const;
-            Iterator& operator++();
-            Iterator  operator++(int);
-            Entity    operator*();
+            bool                     operator==(const Iterator& other) const;
+            bool                     operator!=(const Iterator& other) const;
+            Iterator&                operator++();
+            Iterator                 operator++(int);
+            ViewEntry<Components...> operator*();
 
         private:
             friend class StorageView;
+            void Advance();
+            void Settle();
+
             uint32_t     m_ID;
+            uint32_t     m_Archetype;
+            uint32_t     m_Row;
             StorageView* m_View;
         };
         Iterator begin();
         Iterator end();
         bool     Empty();
 
+        // Only entities whose ComponentType was added (or added or written) after the `Since` tick pass these filters.
+        // Views created by a System use the tick of its previous run. Called on a temporary they return the view by value,
+        // so `for (auto e : View<T>().Changed<T>())` does not dangle.
+        template <typename ComponentType> StorageView& Added() &;
+        template <typename ComponentType> StorageView& Changed() &;
+        StorageView&                                   Since(uint32_t tick) &;
+        template <typename ComponentType> StorageView  Added() &&;
+        template <typename ComponentType> StorageView  Changed() &&;
+        StorageView                                    Since(uint32_t tick) &&;
+
+        // Skips the entities holding any of Excluded. Archetype storage drops the matching archetypes once, pooled storage
+        // tests the entity's signature before the Added/Changed filters.
+        template <typename... Excluded> StorageView& Exclude() &;
+        template <typename... Excluded> StorageView  Exclude() &&;
+
+        template <typename Func> void Each(Func func);
+
+        // Splits the view into ranges of about `grain` entities and runs them on the pool (ThreadPool::Shared() by default).
+        // func is called concurrently and may write the components it is handed, each entity is visited by exactly one task.
+        // Inside the loop it must not add or remove components, create or destroy entities, or touch components of other
+        // entities without its own synchronization: those change pool and archetype layout under the running tasks.
+        template <typename Func> void ParallelEach(Func func, uint32_t grain = 1024, ThreadPool* pool = nullptr);
+
     private:
         friend class Storage;
+        using Columns = std::array<int32_t, sizeof...(Components)>;
+        template <typename Element> using Component = typename ViewElement<Element>::Type;
+
+        // Number of elements entities must hold, optional ones only add a lookup.
+        static constexpr size_t Required = (size_t(ViewElement<Components>::Required) + ... + 0);
+        // Views of required tags and optional components walk the signature matrix instead of a pool.
+        static constexpr bool TagsOnly = Required != 0 && ((IsTag<Component<Components>> || !ViewElement<Components>::Required) && ...);
+        // Whether any element is handed out mutably, views of const elements never touch the ticks.
+        static constexpr bool Writes = (ViewElement<Components>::Writes || ...);
+
+        struct Filter
+        {
+            uint32_t ComponentId;
+            bool     Added;
+        };
+
         StorageView(Storage* storage);
 
-        Signature m_Signature;
-        Storage*  m_Storage;
+        static const Signature& RequiredSignature();
+        static constexpr size_t Lead();
+
+        bool                                            Passes(uint32_t id) const;
+        Entity                                          MakeEntity(uint32_t id) const;
+        template <typename Func> void                   Invoke(Func& func, uint32_t id, Component<Components>*... components) const;
+        // Invoke on pooled components, then marks the mutable ones changed at tick.
+        template <typename Func> void                   Visit(Func& func, uint32_t id, uint32_t tick, Component<Components>*... components) const;
+        template <typename Func, size_t... I> uint32_t  EachScan(Func& func, uint32_t begin, uint32_t end, std::index_sequence<I...>) const;
+        template <typename Func, size_t... I> uint32_t  EachRows(Func& func, Archetype& archetype, const Columns& columns, uint32_t begin, uint32_t end, std::index_sequence<I...>) const;
+        template <typename Func, size_t... I> uint32_t  EachPool(Func& func, uint32_t begin, uint32_t end, std::index_sequence<I...>) const;
+        template <typename Func, size_t... I> uint32_t  EachGroup(Func& func, uint32_t begin, uint32_t end, std::index_sequence<I...>) const;
+        uint32_t                                        PoolEnd() const;
+        template <size_t... I> ViewEntry<Components...> Fetch(uint32_t id, std::index_sequence<I...>) const;
+        template <size_t... I> ViewEntry<Components...> Fetch(uint32_t archetype, uint32_t row, std::index_sequence<I...>) const;
+
+        // The component of one entity in its pool or archetype row, tags lead to their TagInstance and missing optional
+        // components to nullptr.
+        template <typename Element> static Component<Element>* Find(ComponentArray<Component<Element>>* pool, uint32_t id);
+        template <typename Element> static Component<Element>* Find(Archetype& archetype, int32_t column, uint32_t row);
+        // Marks a mutable element written: pooled components find their ticks by their position in the pool, archetype rows
+        // [row, row + count) of one chunk are stamped together.
+        template <typename Element> static void Touch(ComponentArray<Component<Element>>* pool, Component<Element>* component, uint32_t tick);
+        template <typename Element> static void Touch(Archetype& archetype, int32_t column, uint32_t row, uint32_t count, uint32_t tick);
+
+        const Signature&                                      m_Signature;
+        std::vector<Archetype*>                               m_Archetypes;
+        std::vector<Columns>                                  m_Columns;
+        const SparseSet*                                      m_Pool;
+        const OwningGroup*                                    m_Group;
+        bool                                                  m_Cached;
+        std::tuple<ComponentArray<Component<Components>>*...> m_Pools;
+        std::vector<Filter>                                   m_Filters;
+        Signature                                             m_Excluded;
+        bool                                                  m_Excluding;
+        uint32_t                                              m_Since;
+        Storage*                                              m_Storage;
+    };
+
+    //*___FRAME_BUFFER_____________________________________________________________________________________________________________________________________________________________________________________________
+
+    // Double-buffered read-only copies of the Components of a Storage for reader threads such as rendering or networking.
+    // The simulation thread calls Publish between updates: it copies the entity slots and the pools of Components into the
+    // back frame and swaps it to the front. Readers take the front frame with Acquire (nullptr before the first Publish) and
+    // iterate it through View while the simulation writes the next tick. A back frame still held by a reader is left to it
+    // and Publish starts a new one, otherwise the frame's buffers are reused and publishing does not allocate once they
+    // have grown. A reused frame from a pooled Storage only takes the components written since it was last published,
+    // unless entities entered or left a pool.
+    // Frames are pooled Storages that readers must not modify. Mutable access stamps a write tick, so readers sharing a frame
+    // use View<const T> and Entity::Get<const T>.
+    template <typename... Components> class FrameBuffer
+    {
+    public:
+        FrameBuffer(Storage& storage);
+
+        void                     Publish();
+        std::shared_ptr<Storage> Acquire() const;
+
+    private:
+        Storage&                 m_Storage;
+        std::shared_ptr<Storage> m_Front;
+        std::shared_ptr<Storage> m_Back;
+        mutable std::mutex       m_Mutex;
     };
 
 }  // namespace ECS
 
+#include "TypeId.hpp"
+#include "Memory.hpp"
+#include "Snapshot.hpp"
 #include "ComponentArray.hpp"
+#include "Archetype.hpp"
 #include "ComponentManager.hpp"
 #include "EntityManager.hpp"
 #include "Entity.hpp"
+#include "ObserverManager.hpp"
 #include "Storage.hpp"
 #include "StorageView.hpp"
+#include "FrameBuffer.hpp"
+#include "CommandBuffer.hpp"
+#include "ThreadPool.hpp"
 #include "System.hpp"
+#include "Profiler.hpp"
 #include "SystemManager.hpp"
\ No newline at end of file
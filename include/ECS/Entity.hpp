@@ -17,7 +17,15 @@ namespace ECS
 
     template <typename ComponentType> ComponentType* Entity::Add(ComponentType component)
     {
-        return (m_Storage ? m_Storage->AddComponent<ComponentType>(m_ID, m_Gen, component) : nullptr);
+        return (m_Storage ? m_Storage->EmplaceComponent<ComponentType>(m_ID, m_Gen, std::move(component)) : nullptr);
+    }
+    template <typename ComponentType, typename... Args> ComponentType* Entity::Emplace(Args&&... args)
+    {
+        return (m_Storage ? m_Storage->EmplaceComponent<ComponentType>(m_ID, m_Gen, std::forward<Args>(args)...) : nullptr);
+    }
+    template <typename ComponentType, typename... Args> ComponentType* Entity::Replace(Args&&... args)
+    {
+        return (m_Storage ? m_Storage->ReplaceComponent<ComponentType>(m_ID, m_Gen, std::forward<Args>(args)...) : nullptr);
     }
     template <typename ComponentType> ComponentType* Entity::Get()
     {
@@ -38,6 +46,16 @@ namespace ECS
             m_Storage->RemoveComponent<ComponentType>(m_ID, m_Gen);
         }
     }
+    template <typename ComponentType, typename Func> bool Entity::Patch(Func func)
+    {
+        return (m_Storage ? m_Storage->PatchComponent<ComponentType>(m_ID, m_Gen, func) : false);
+    }
+    template <typename ComponentType> bool Entity::MarkChanged() { return (m_Storage ? m_Storage->MarkChanged<ComponentType>(m_ID, m_Gen) : false); }
+
+    bool Entity::SetParent(const Entity& parent) { return (m_Storage ? m_Storage->SetParent(m_ID, m_Gen, parent) : false); }
+    Entity Entity::Parent() const { return (m_Storage ? m_Storage->Related(m_ID, m_Gen, &Hierarchy::Parent) : Entity()); }
+    Entity Entity::FirstChild() const { return (m_Storage ? m_Storage->Related(m_ID, m_Gen, &Hierarchy::FirstChild) : Entity()); }
+    Entity Entity::NextSibling() const { return (m_Storage ? m_Storage->Related(m_ID, m_Gen, &Hierarchy::NextSibling) : Entity()); }
 
     bool Entity::operator==(const Entity& other) const { return m_ID == other.m_ID && m_Gen == other.m_Gen && m_Storage == other.m_Storage; }
     bool Entity::operator!=(const Entity& other) const { return m_ID != other.m_ID || m_Gen != other.m_Gen || m_Storage != other.m_Storage; }
@@ -3,50 +3,138 @@
 namespace ECS
 {
 
+    EntityManager::EntityManager(std::pmr::memory_resource* resource) : m_Generations(resource), m_Next(resource), m_Alive(resource) {}
+
     std::pair<uint32_t, uint32_t> EntityManager::CreateEntity()
     {
-        if (m_AvailableEntities.empty())
+        uint32_t id = Revive();
+        if (id == Null)
+        {
+            assert(m_Generations.size() < Null && "Entity ids exhausted");
+            id = m_Generations.size();
+            m_Generations.push_back(1);
+            m_Next.push_back(Null);
+            SetAlive(id, true);
+        }
+        return std::make_pair(id, Generation(id));
+    }
+    void EntityManager::CreateEntities(uint32_t count, std::vector<uint32_t>& ids)
+    {
+        ids.reserve(ids.size() + count);
+        for (; count != 0 && m_FreeHead != Null; --count)
+        {
+            ids.push_back(Revive());
+        }
+        uint32_t first = m_Generations.size();
+        assert(uint64_t(first) + count < Null && "Entity ids exhausted");
+        m_Generations.resize(first + count, 1);
+        m_Next.resize(first + count, Null);
+        m_Alive.resize((first + count + 63) / 64, 0);
+        for (uint32_t id = first; id < first + count; ++id)
         {
-            m_AvailableEntities.push(m_States.size());
-            m_States.push_back(false);
-            m_Generations.push_back(0);
+            m_Alive[id / 64] |= uint64_t(1) << (id % 64);
+            ids.push_back(id);
         }
-        auto id = m_AvailableEntities.front();
-        m_AvailableEntities.pop();
-        m_States[id] = true;
-        ++m_Generations[id];
-        return std::make_pair(id, m_Generations[id]);
     }
     void EntityManager::Destroy(uint32_t id)
     {
-        m_States[id] = false;
-        m_AvailableEntities.push(id);
+        (m_FreeTail == Null ? m_FreeHead : m_Next[m_FreeTail]) = id;
+        m_FreeTail                                             = id;
+        SetAlive(id, false);
     }
-    bool EntityManager::Valid(uint32_t id, uint32_t gen) const { return m_States[id] && m_Generations[id] == gen; }
+    bool EntityManager::Valid(uint32_t id, uint32_t gen) const { return Alive(id) && Generation(id) == gen; }
+    bool EntityManager::Alive(uint32_t id) const { return id < m_Generations.size() && (m_Alive[id / 64] >> (id % 64) & 1); }
 
-    uint32_t EntityManager::NextEntity(uint32_t id) const
+    uint32_t EntityManager::NextEntity(uint32_t id) const { return (id >= m_Generations.size() ? m_Generations.size() : FindAlive(id + 1)); }
+    uint32_t EntityManager::Generation(uint32_t id) const { return m_Generations[id]; }
+    uint32_t EntityManager::BeginEntity() const { return FindAlive(0); }
+    uint32_t EntityManager::EndEntity() const { return m_Generations.size(); }
+
+    // Skips whole words of dead ids, so scanning a sparse world costs one step per 64 ids rather than one per id.
+    uint32_t EntityManager::FindAlive(uint32_t id) const
     {
-        if (id >= m_States.size())
+        size_t word = id / 64;
+        if (word >= m_Alive.size())
         {
-            return m_States.size();
+            return m_Generations.size();
         }
-        do
+        uint64_t bits = m_Alive[word] & (~uint64_t(0) << (id % 64));
+        while (bits == 0)
         {
-            ++id;
+            if (++word == m_Alive.size())
+            {
+                return m_Generations.size();
+            }
+            bits = m_Alive[word];
+        }
+        return word * 64 + std::countr_zero(bits);
+    }
+    uint32_t EntityManager::Revive()
+    {
+        uint32_t id = m_FreeHead;
+        if (id != Null)
+        {
+            m_FreeHead = m_Next[id];
+            m_FreeTail = (m_FreeHead == Null ? Null : m_FreeTail);
+            m_Next[id] = Null;
+            if (++m_Generations[id] == 0)
+            {
+                m_Generations[id] = 1;
+            }
+            SetAlive(id, true);
         }
-        while (id < m_States.size() && !m_States[id]);
         return id;
     }
-    uint32_t EntityManager::Generation(uint32_t id) const { return m_Generations[id]; }
-    uint32_t EntityManager::BeginEntity() const
+    void EntityManager::SetAlive(uint32_t id, bool alive)
     {
-        uint32_t res = 0;
-        while (res < m_States.size() && !m_States[res])
+        if (m_Alive.size() <= id / 64)
+        {
+            m_Alive.resize(id / 64 + 1, 0);
+        }
+        if (alive)
+        {
+            m_Alive[id / 64] |= uint64_t(1) << (id % 64);
+        }
+        else
+        {
+            m_Alive[id / 64] &= ~(uint64_t(1) << (id % 64));
+        }
+    }
+    void EntityManager::Save(SnapshotWriter& writer) const
+    {
+        writer.Align();
+        writer.Write(m_Generations.data(), m_Generations.size() * sizeof(uint32_t));
+        writer.Align();
+        writer.Write(m_Next.data(), m_Next.size() * sizeof(uint32_t));
+        writer.Align();
+        writer.Write(m_Alive.data(), (m_Generations.size() + 63) / 64 * sizeof(uint64_t));
+    }
+    void EntityManager::Restore(const uint32_t* generations, const uint32_t* next, const uint64_t* alive, uint32_t count, uint32_t free_head, uint32_t free_tail)
+    {
+        m_Generations.assign(generations, generations + count);
+        m_Next.assign(next, next + count);
+        m_Alive.assign(alive, alive + (count + 63) / 64);
+        m_FreeHead = free_head;
+        m_FreeTail = free_tail;
+    }
+    bool EntityManager::Verify(const uint32_t* next, const uint64_t* alive, uint32_t count, uint32_t free_head, uint32_t free_tail)
+    {
+        const auto link = [count](uint32_t id) { return id < count || id == Null; };
+        if (!link(free_head) || (count % 64 != 0 && alive[count / 64] >> (count % 64) != 0))
+        {
+            return false;
+        }
+        // The free list has to be a chain of dead ids that ends at the tail, without a cycle.
+        uint32_t last  = Null;
+        uint32_t steps = 0;
+        for (uint32_t id = free_head; id != Null; last = id, id = next[id])
         {
-            ++res;
+            if (!link(next[id]) || (alive[id / 64] >> (id % 64) & 1) || ++steps > count)
+            {
+                return false;
+            }
         }
-        return res;
+        return last == free_tail;
     }
-    uint32_t EntityManager::EndEntity() const { return m_States.size(); }
 
-}  // namespace ECS
\ No newline at end of file
+}  // namespace ECS
@@ -0,0 +1,30 @@
+#pragma once
+
+namespace ECS
+{
+
+    template <typename... Components> FrameBuffer<Components...>::FrameBuffer(Storage& storage) : m_Storage(storage)
+    {
+        static_assert((std::is_copy_assignable_v<Components> && ...), "Published components are copied into the frames");
+    }
+
+    template <typename... Components> void FrameBuffer<Components...>::Publish()
+    {
+        // Only the writer reaches the back frame, readers may just drop their references to it, so a count of one means
+        // every reader is done with it. The count is read relaxed, the fence orders the copy after the readers' releases.
+        if (!m_Back || m_Back.use_count() != 1)
+        {
+            m_Back = std::make_shared<Storage>(StorageMode::Pooled);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        m_Storage.CopyTo<Components...>(*m_Back);
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        std::swap(m_Front, m_Back);
+    }
+    template <typename... Components> std::shared_ptr<Storage> FrameBuffer<Components...>::Acquire() const
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        return m_Front;
+    }
+
+}  // namespace ECS
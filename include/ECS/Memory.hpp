@@ -0,0 +1,99 @@
+#pragma once
+
+namespace ECS
+{
+
+    PageArena::PageArena(size_t page_size, std::pmr::memory_resource* upstream) :
+        m_Upstream(upstream), m_PageSize(std::max(std::bit_ceil(page_size), 4 * MinBlock)), m_Cursor(nullptr), m_End(nullptr), m_Allocated(0)
+    {
+    }
+    PageArena::~PageArena() { Free(); }
+
+    bool PageArena::Release()
+    {
+        if (m_Allocated != 0)
+        {
+            return false;
+        }
+        Free();
+        return true;
+    }
+    void PageArena::Free()
+    {
+        for (void* page : m_Pages)
+        {
+            m_Upstream->deallocate(page, m_PageSize, PageAlignment);
+        }
+        for (const Large& large : m_Large)
+        {
+            m_Upstream->deallocate(large.Pointer, large.Bytes, large.Alignment);
+        }
+        m_Pages.clear();
+        m_Large.clear();
+        m_FreeLists.clear();
+        m_Cursor    = nullptr;
+        m_End       = nullptr;
+        m_Allocated = 0;
+    }
+    size_t PageArena::Allocated() const { return m_Allocated; }
+
+    void* PageArena::do_allocate(size_t bytes, size_t alignment)
+    {
+        const size_t size = SizeClass(bytes);
+        if (size > m_PageSize / 4 || alignment > std::min(size, PageAlignment))
+        {
+            m_Large.push_back({m_Upstream->allocate(bytes, alignment), bytes, alignment});
+            m_Allocated += bytes;
+            return m_Large.back().Pointer;
+        }
+        const size_t index = std::countr_zero(size / MinBlock);
+        if (m_FreeLists.size() <= index)
+        {
+            m_FreeLists.resize(index + 1, nullptr);
+        }
+        m_Allocated += size;
+        if (Block* block = m_FreeLists[index])
+        {
+            m_FreeLists[index] = block->Next;
+            return block;
+        }
+        // Blocks are aligned to their own size up to a page, so a recycled block suits any request of its class.
+        const size_t align  = std::min(size, PageAlignment);
+        std::byte*   cursor = (m_Cursor ? m_Cursor + (align - reinterpret_cast<uintptr_t>(m_Cursor) % align) % align : nullptr);
+        if (!cursor || cursor + size > m_End)
+        {
+            m_Pages.push_back(m_Upstream->allocate(m_PageSize, PageAlignment));
+            cursor = static_cast<std::byte*>(m_Pages.back());
+            m_End  = cursor + m_PageSize;
+        }
+        m_Cursor = cursor + size;
+        return cursor;
+    }
+    void PageArena::do_deallocate(void* ptr, size_t bytes, size_t alignment)
+    {
+        const size_t size = SizeClass(bytes);
+        if (size > m_PageSize / 4 || alignment > std::min(size, PageAlignment))
+        {
+            auto it = std::find_if(m_Large.begin(), m_Large.end(), [ptr](const Large& large) { return large.Pointer == ptr; });
+            assert(it != m_Large.end() && "Block was not allocated by this arena");
+            if (it == m_Large.end())
+            {
+                return;
+            }
+            m_Upstream->deallocate(ptr, bytes, alignment);
+            *it = m_Large.back();
+            m_Large.pop_back();
+            m_Allocated -= bytes;
+            return;
+        }
+        const size_t index = std::countr_zero(size / MinBlock);
+        Block*       block = static_cast<Block*>(ptr);
+        block->Next        = m_FreeLists[index];
+        m_FreeLists[index] = block;
+        m_Allocated -= size;
+    }
+    bool PageArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept { return this == &other; }
+
+    size_t PageArena::SizeClass(size_t bytes) { return std::max(std::bit_ceil(bytes), MinBlock); }
+
+}  // namespace ECS
@@ -0,0 +1,72 @@
+#pragma once
+
+namespace ECS
+{
+
+    void ObserverManager::Observe(Lifecycle kind, uint32_t component_id, Callback callback)
+    {
+        if (m_Delivering)
+        {
+            m_Pending.push_back({kind, component_id, std::move(callback)});
+            return;
+        }
+        if (m_Channels.size() <= component_id)
+        {
+            m_Channels.resize(component_id + 1);
+        }
+        if (!m_Channels[component_id])
+        {
+            m_Channels[component_id] = std::make_unique<Channel>();
+        }
+        m_Channels[component_id]->Callbacks[size_t(kind)].push_back(std::move(callback));
+    }
+    bool ObserverManager::Active() const { return !m_Channels.empty(); }
+    bool ObserverManager::Observed(uint32_t component_id) const { return component_id < m_Channels.size() && m_Channels[component_id]; }
+    void ObserverManager::Record(Lifecycle kind, uint32_t component_id, const Entity& entity)
+    {
+        Channel& channel = *m_Channels[component_id];
+        if (!channel.Callbacks[size_t(kind)].empty())
+        {
+            channel.Entities.push_back(entity);
+            channel.Kinds.push_back(kind);
+        }
+    }
+    // Observers added by callbacks are held back until the batch is delivered, so the callback lists never grow while
+    // one of their callbacks runs.
+    void ObserverManager::Deliver()
+    {
+        m_Delivering = true;
+        for (size_t i = 0; i < m_Channels.size(); ++i)
+        {
+            Channel* channel = m_Channels[i].get();
+            if (!channel || channel->Entities.empty())
+            {
+                continue;
+            }
+            std::swap(channel->Entities, channel->Delivering);
+            std::swap(channel->Kinds, channel->DeliveringKinds);
+            const std::vector<Entity>&    entities = channel->Delivering;
+            const std::vector<Lifecycle>& kinds    = channel->DeliveringKinds;
+            for (size_t begin = 0, end; begin < kinds.size(); begin = end)
+            {
+                for (end = begin + 1; end < kinds.size() && kinds[end] == kinds[begin];)
+                {
+                    ++end;
+                }
+                for (const Callback& callback : channel->Callbacks[size_t(kinds[begin])])
+                {
+                    callback(std::span<const Entity>(entities.data() + begin, end - begin));
+                }
+            }
+            channel->Delivering.clear();
+            channel->DeliveringKinds.clear();
+        }
+        m_Delivering = false;
+        for (Pending& pending : m_Pending)
+        {
+            Observe(pending.Kind, pending.ComponentId, std::move(pending.Function));
+        }
+        m_Pending.clear();
+    }
+
+}  // namespace ECS
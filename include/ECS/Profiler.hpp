@@ -0,0 +1,132 @@
+#pragma once
+
+#ifdef ECS_PROFILE
+
+namespace ECS
+{
+
+    Profiler::Adopt::Adopt(Counters* counters) : m_Previous(t_Current) { t_Current = counters; }
+    Profiler::Adopt::~Adopt() { t_Current = m_Previous; }
+
+    Profiler::Profiler() : m_Epoch(std::chrono::steady_clock::now()) {}
+
+    std::vector<Profiler::Statistics> Profiler::Stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        std::vector<Statistics>     res;
+        std::vector<uint64_t>       durations;
+        for (const History& history : m_Systems)
+        {
+            if (history.Updates == 0)
+            {
+                continue;
+            }
+            const uint32_t count = std::min<uint64_t>(history.Updates, Window);
+            Statistics     stats{history.Name, history.Updates, 0, 0, 0, 0, 0};
+            durations.clear();
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                durations.push_back(history.Samples[i].Duration);
+                stats.Avg += history.Samples[i].Duration;
+                stats.Visited += history.Samples[i].Visited;
+                stats.Changes += history.Samples[i].Changes;
+            }
+            std::sort(durations.begin(), durations.end());
+            stats.Min = durations.front() / 1000.0;
+            stats.P99 = durations[(count * 99 + 99) / 100 - 1] / 1000.0;
+            stats.Avg /= count * 1000.0;
+            stats.Visited /= count;
+            stats.Changes /= count;
+            res.push_back(std::move(stats));
+        }
+        return res;
+    }
+    // Writes the Trace Event Format understood by chrome://tracing and Perfetto, one complete event per system update.
+    bool Profiler::WriteTrace(const std::string& path) const
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        std::ofstream               file(path);
+        file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        for (size_t i = 0; i < m_Events.size(); ++i)
+        {
+            const Event& event = m_Events[i];
+            file << (i == 0 ? "\n" : ",\n") << "{\"name\":\"";
+            for (char c : m_Systems[event.System].Name)
+            {
+                if (c == '"' || c == '\\')
+                {
+                    file << '\\';
+                }
+                file << (static_cast<unsigned char>(c) < 0x20 ? ' ' : c);
+            }
+            file << "\",\"cat\":\"system\",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.Thread << ",\"ts\":" << event.Start / 1000.0
+                 << ",\"dur\":" << event.Data.Duration / 1000.0 << ",\"args\":{\"entities\":" << event.Data.Visited
+                 << ",\"changes\":" << event.Data.Changes << "}}";
+        }
+        file << "\n]}\n";
+        return file.good();
+    }
+    void Profiler::Clear()
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        for (History& history : m_Systems)
+        {
+            history.Updates = 0;
+        }
+        m_Events.clear();
+    }
+
+    Profiler::Counters* Profiler::Current() { return t_Current; }
+    void                Profiler::CountVisits(uint64_t count)
+    {
+        if (t_Current && count != 0)
+        {
+            t_Current->Visited.fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+    void Profiler::CountChanges(uint64_t count)
+    {
+        if (t_Current && count != 0)
+        {
+            t_Current->Changes.fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+
+    void Profiler::Run(uint32_t system, System& instance, float dt)
+    {
+        Counters counters;
+        uint64_t start = Now();
+        {
+            Adopt adopt(&counters);
+            instance.Update(dt);
+        }
+        Event event{system, t_Thread, start, {Now() - start, counters.Visited.load(), counters.Changes.load()}};
+        if (event.Thread == UINT32_MAX)
+        {
+            event.Thread = t_Thread = s_NextThread++;
+        }
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_Systems.size() <= system)
+        {
+            m_Systems.resize(system + 1);
+        }
+        History& history = m_Systems[system];
+        if (history.Name.empty())
+        {
+            history.Name = instance.GetName();
+        }
+        history.Samples[history.Updates++ % Window] = event.Data;
+        if (m_Events.size() < MaxEvents)
+        {
+            m_Events.push_back(event);
+        }
+    }
+    uint64_t Profiler::Now() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_Epoch).count();
+    }
+
+}  // namespace ECS
+
+#endif
@@ -0,0 +1,144 @@
+#pragma once
+
+namespace ECS
+{
+
+    //*___SNAPSHOT_WRITER___________________________________________________________________________________________________________________________________________________________________________________________
+
+    void                       SnapshotWriter::Write(const void* data, size_t size) { m_Buffer.append(static_cast<const char*>(data), size); }
+    template <typename T> void SnapshotWriter::Write(const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values are written as bytes");
+        Write(&value, sizeof(T));
+    }
+    void   SnapshotWriter::Align() { m_Buffer.resize((m_Buffer.size() + Alignment - 1) / Alignment * Alignment, '\0'); }
+    size_t SnapshotWriter::Offset() const { return m_Buffer.size(); }
+    template <typename T> void SnapshotWriter::Patch(size_t offset, const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values are written as bytes");
+        std::memcpy(m_Buffer.data() + offset, &value, sizeof(T));
+    }
+    bool SnapshotWriter::WriteFile(const std::string& path) const
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(m_Buffer.data(), m_Buffer.size());
+        return bool(file);
+    }
+
+    //*___SNAPSHOT_READER___________________________________________________________________________________________________________________________________________________________________________________________
+
+    SnapshotReader::SnapshotReader(const std::string& path)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        int file = open(path.c_str(), O_RDONLY);
+        if (file == -1)
+        {
+            return;
+        }
+        struct stat info;
+        if (fstat(file, &info) == 0 && info.st_size > 0)
+        {
+            void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+            if (data != MAP_FAILED)
+            {
+                m_Data  = static_cast<const std::byte*>(data);
+                m_Size  = info.st_size;
+                m_Good  = true;
+                m_Owned = true;
+            }
+        }
+        close(file);
+#else
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file || file.tellg() <= 0)
+        {
+            return;
+        }
+        m_Size          = file.tellg();
+        std::byte* data = static_cast<std::byte*>(::operator new(m_Size, std::align_val_t(SnapshotWriter::Alignment)));
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(data), m_Size);
+        m_Data  = data;
+        m_Good  = bool(file);
+        m_Owned = true;
+#endif
+    }
+    SnapshotReader::SnapshotReader(const std::byte* data, size_t size) : m_Data(data), m_Size(size), m_Good(true) {}
+    SnapshotReader::~SnapshotReader()
+    {
+        if (!m_Owned)
+        {
+            return;
+        }
+#if defined(__unix__) || defined(__APPLE__)
+        munmap(const_cast<std::byte*>(m_Data), m_Size);
+#else
+        ::operator delete(const_cast<std::byte*>(m_Data), std::align_val_t(SnapshotWriter::Alignment));
+#endif
+    }
+
+    bool             SnapshotReader::Good() const { return m_Good; }
+    const std::byte* SnapshotReader::Read(size_t size)
+    {
+        if (!m_Good || size > m_Size - m_Offset)
+        {
+            m_Good = false;
+            return nullptr;
+        }
+        const std::byte* res = m_Data + m_Offset;
+        m_Offset += size;
+        return res;
+    }
+    template <typename T> T SnapshotReader::Read()
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values are read as bytes");
+        T res{};
+        if (const std::byte* data = Read(sizeof(T)))
+        {
+            std::memcpy(&res, data, sizeof(T));
+        }
+        return res;
+    }
+    template <typename T> const T* SnapshotReader::ReadArray(size_t count)
+    {
+        Align();
+        if (count > (m_Size - m_Offset) / sizeof(T))
+        {
+            m_Good = false;
+            return nullptr;
+        }
+        return reinterpret_cast<const T*>(Read(count * sizeof(T)));
+    }
+    void SnapshotReader::Align() { m_Offset = std::min(m_Size, (m_Offset + SnapshotWriter::Alignment - 1) / SnapshotWriter::Alignment * SnapshotWriter::Alignment); }
+
+    bool SnapshotReader::ReadColumn(SnapshotColumn& column)
+    {
+        SnapshotColumnHeader header = Read<SnapshotColumnHeader>();
+        const std::byte*     name   = Read(header.NameLength);
+        if (!name)
+        {
+            return false;
+        }
+        column.Name        = std::string(reinterpret_cast<const char*>(name), header.NameLength);
+        column.Raw         = header.Raw;
+        column.Size        = header.Size;
+        column.Count       = header.Count;
+        column.Pages       = header.Pages;
+        column.Entities    = ReadArray<uint32_t>(header.Count);
+        column.PageIndices = ReadArray<uint32_t>(header.Pages);
+        column.PageData    = ReadArray<uint32_t>(size_t(header.Pages) * SparseSet::PageSize);
+        column.Ticks       = ReadArray<ComponentTicks>(header.Count);
+        if (column.Raw)
+        {
+            column.Bytes = size_t(header.Count) * header.Size;
+            Align();
+        }
+        else
+        {
+            column.Bytes = Read<uint64_t>();
+        }
+        column.Data = Read(column.Bytes);
+        return Good();
+    }
+
+}  // namespace ECS
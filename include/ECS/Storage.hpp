@@ -3,38 +3,381 @@
 namespace ECS
 {
 
-    Storage::Storage() : m_SystemManager(this) {}
+    Storage::Storage(StorageMode mode, std::pmr::memory_resource* resource) :
+        m_EntityManager(resource), m_ComponentManager(mode, resource), m_SystemManager(this), m_Serial(s_NextSerial++)
+    {
+    }
     Entity Storage::CreateEntity()
     {
         auto [id, gen] = m_EntityManager.CreateEntity();
-        Entity ent;
-        ent.m_ID      = id;
-        ent.m_Gen     = gen;
-        ent.m_Storage = this;
-        return ent;
+        Profiler::CountChanges(1);
+        return MakeEntity(id, gen);
+    }
+    template <typename... Components> std::vector<Entity> Storage::CreateEntities(uint32_t count, const Components&... components)
+    {
+        static_assert((!std::is_same_v<Components, Hierarchy> && ...), "Hierarchy links are set through Entity::SetParent");
+        std::vector<uint32_t> ids;
+        m_EntityManager.CreateEntities(count, ids);
+        m_ComponentManager.Spawn(ids, components...);
+        Profiler::CountChanges(ids.size());
+        if (m_ObserverManager.Active())
+        {
+            for (uint32_t component_id : {ComponentTypeId::Get<Components>()...})
+            {
+                for (uint32_t id : ids)
+                {
+                    Notify(Lifecycle::Add, component_id, id);
+                }
+            }
+        }
+
+        std::vector<Entity> res;
+        res.reserve(ids.size());
+        for (uint32_t id : ids)
+        {
+            res.push_back(MakeEntity(id, m_EntityManager.Generation(id)));
+        }
+        return res;
+    }
+    template <typename ComponentType, typename EntityIt, typename ValueIt> void Storage::Insert(EntityIt first, EntityIt last, ValueIt values)
+    {
+        static_assert(!std::is_same_v<ComponentType, Hierarchy>, "Hierarchy links are set through Entity::SetParent");
+        std::vector<uint32_t> ids;
+        for (EntityIt it = first; it != last; ++it)
+        {
+            if (Valid(it->m_ID, it->m_Gen))
+            {
+                ids.push_back(it->m_ID);
+            }
+        }
+        // Values of invalid entities are skipped so the two ranges stay aligned.
+        auto source = [this, &first, &values]() -> decltype(auto)
+        {
+            while (!Valid(first->m_ID, first->m_Gen))
+            {
+                ++first;
+                ++values;
+            }
+            ++first;
+            return *values++;
+        };
+        std::vector<uint32_t> added;
+        if (m_ObserverManager.Observed(ComponentTypeId::Get<ComponentType>()))
+        {
+            std::copy_if(ids.begin(), ids.end(), std::back_inserter(added), [this](uint32_t id) { return !m_ComponentManager.HasComponent<ComponentType>(id); });
+        }
+        m_ComponentManager.Insert<ComponentType>(ids.data(), ids.size(), source);
+        Profiler::CountChanges(ids.size());
+        for (uint32_t id : added)
+        {
+            Notify(Lifecycle::Add, ComponentTypeId::Get<ComponentType>(), id);
+        }
     }
     template <typename... Components> StorageView<Components...> Storage::View() { return StorageView<Components...>(this); }
 
-    template <typename SystemType> void Storage::RegisterSystem() { m_SystemManager.RegisterSystem<SystemType>(); }
-    void                                Storage::UpdateSystems(float dt) { m_SystemManager.Update(dt); }
+    template <typename... Components> const Query& Storage::CacheQuery()
+    {
+        static_assert(sizeof...(Components) != 0, "Cached query needs at least one component");
+        return m_ComponentManager.RegisterQuery(ComponentManager::BuildSignature<Components...>());
+    }
+#ifdef ECS_PROFILE
+    template <typename... Components> uint64_t Storage::QueryMisses() const
+    {
+        return m_ComponentManager.QueryMisses(ComponentManager::BuildSignature<Components...>());
+    }
+#endif
+    template <typename... Components> void Storage::SortHierarchy() { m_ComponentManager.SortHierarchy<Components...>(); }
+    template <typename... Components> const OwningGroup* Storage::Group()
+    {
+        static_assert(sizeof...(Components) != 0, "Group needs at least one component");
+        return m_ComponentManager.RegisterGroup<Components...>();
+    }
+    template <typename ComponentType, typename Compare> void Storage::Sort(Compare compare) { m_ComponentManager.Sort<ComponentType>(compare); }
+    template <typename Leader, typename Follower> void       Storage::Sort() { m_ComponentManager.Sort<Leader, Follower>(); }
+
+    template <typename SystemType> void             Storage::RegisterSystem() { m_SystemManager.RegisterSystem<SystemType>(); }
+    template <typename Before, typename After> bool Storage::AddSystemDependency() { return m_SystemManager.AddDependency<Before, After>(); }
+    void                                            Storage::SetExecutionMode(ExecutionMode mode, ThreadPool* pool) { m_SystemManager.SetExecutionMode(mode, pool); }
+    void                                            Storage::UpdateSystems(float dt) { m_SystemManager.Update(dt); }
+#ifdef ECS_PROFILE
+    Profiler& Storage::GetProfiler() { return m_SystemManager.GetProfiler(); }
+#endif
+
+    CommandBuffer& Storage::Commands()
+    {
+        // The serial guards against a new Storage reusing the address of a destroyed one.
+        if (t_CommandCache.Owner == this && t_CommandCache.Serial == m_Serial)
+        {
+            return *t_CommandCache.Buffer;
+        }
+        std::lock_guard<std::mutex> lock(m_CommandMutex);
+        CommandBuffer*              buffer = nullptr;
+        for (const auto& [thread, commands] : m_CommandBuffers)
+        {
+            if (thread == std::this_thread::get_id())
+            {
+                buffer = commands.get();
+            }
+        }
+        if (!buffer)
+        {
+            m_CommandBuffers.emplace_back(std::this_thread::get_id(), std::make_unique<CommandBuffer>());
+            buffer = m_CommandBuffers.back().second.get();
+        }
+        t_CommandCache = {this, m_Serial, buffer};
+        return *buffer;
+    }
+    void Storage::FlushCommands()
+    {
+        std::lock_guard<std::mutex>         lock(m_CommandMutex);
+        std::vector<CommandBuffer::Created> created(m_CommandBuffers.size());
+        size_t                              buckets = 0;
+        for (size_t i = 0; i < m_CommandBuffers.size(); ++i)
+        {
+            CommandBuffer& buffer = *m_CommandBuffers[i].second;
+            created[i].reserve(buffer.m_Creates);
+            for (uint32_t j = 0; j < buffer.m_Creates; ++j)
+            {
+                created[i].push_back(m_EntityManager.CreateEntity());
+            }
+            buckets = std::max(buckets, buffer.m_Buckets.size());
+        }
+        for (size_t component_id = 0; component_id < buckets; ++component_id)
+        {
+            uint32_t                adds  = 0;
+            CommandBuffer::IBucket* first = nullptr;
+            for (const auto& [thread, buffer] : m_CommandBuffers)
+            {
+                if (component_id < buffer->m_Buckets.size() && buffer->m_Buckets[component_id])
+                {
+                    adds += buffer->m_Buckets[component_id]->Adds();
+                    first = (first ? first : buffer->m_Buckets[component_id].get());
+                }
+            }
+            if (adds != 0)
+            {
+                first->Reserve(*this, adds);
+            }
+            for (size_t i = 0; i < m_CommandBuffers.size(); ++i)
+            {
+                CommandBuffer& buffer = *m_CommandBuffers[i].second;
+                if (component_id < buffer.m_Buckets.size() && buffer.m_Buckets[component_id])
+                {
+                    buffer.m_Buckets[component_id]->Playback(*this, created[i]);
+                }
+            }
+        }
+        std::vector<CommandBuffer::Target> destroys;
+        for (size_t i = 0; i < m_CommandBuffers.size(); ++i)
+        {
+            for (CommandBuffer::Target target : m_CommandBuffers[i].second->m_Destroys)
+            {
+                CommandBuffer::Resolve(target, created[i]);
+                destroys.push_back(target);
+            }
+            m_CommandBuffers[i].second->Clear();
+        }
+        std::sort(destroys.begin(), destroys.end(), [](const auto& lhs, const auto& rhs) { return lhs.ID < rhs.ID; });
+        for (const auto& target : destroys)
+        {
+            Destroy(target.ID, target.Gen);
+        }
+    }
+    template <typename ComponentType> void Storage::OnAdd(ObserverManager::Callback callback)
+    {
+        m_ObserverManager.Observe(Lifecycle::Add, ComponentTypeId::Get<ComponentType>(), std::move(callback));
+    }
+    template <typename ComponentType> void Storage::OnRemove(ObserverManager::Callback callback)
+    {
+        m_ObserverManager.Observe(Lifecycle::Remove, ComponentTypeId::Get<ComponentType>(), std::move(callback));
+    }
+    template <typename ComponentType> void Storage::OnDestroy(ObserverManager::Callback callback)
+    {
+        m_ObserverManager.Observe(Lifecycle::Destroy, ComponentTypeId::Get<ComponentType>(), std::move(callback));
+    }
+    void Storage::FlushEvents() { m_ObserverManager.Deliver(); }
+
+    template <typename ResourceType, typename... Args> ResourceType* Storage::SetResource(Args&&... args)
+    {
+        const uint32_t resource_id = ResourceTypeId::Get<ResourceType>();
+        if (m_Resources.size() <= resource_id)
+        {
+            m_Resources.resize(resource_id + 1);
+        }
+        m_Resources[resource_id] = std::make_shared<ResourceType>(std::forward<Args>(args)...);
+        return static_cast<ResourceType*>(m_Resources[resource_id].get());
+    }
+    template <typename ResourceType> ResourceType* Storage::GetResource()
+    {
+        const uint32_t resource_id = ResourceTypeId::Get<ResourceType>();
+        return (resource_id < m_Resources.size() ? static_cast<ResourceType*>(m_Resources[resource_id].get()) : nullptr);
+    }
+    template <typename ResourceType> void Storage::RemoveResource()
+    {
+        const uint32_t resource_id = ResourceTypeId::Get<ResourceType>();
+        if (resource_id < m_Resources.size())
+        {
+            m_Resources[resource_id].reset();
+        }
+    }
+
+    uint32_t Storage::Tick() const { return m_ComponentManager.Tick(); }
+    uint32_t Storage::AdvanceTick() { return m_ComponentManager.AdvanceTick(); }
+
+    template <typename ComponentType> void Storage::RegisterSnapshot(const std::string& name)
+    {
+        static_assert(std::is_trivially_copyable_v<ComponentType>, "Components that are not trivially copyable need a serializer");
+        m_ComponentManager.RegisterSnapshot<ComponentType>(name, {});
+    }
+    template <typename ComponentType> void Storage::RegisterSnapshot(const std::string& name, Serializer<ComponentType> serializer)
+    {
+        m_ComponentManager.RegisterSnapshot<ComponentType>(name, serializer);
+    }
+    bool Storage::SaveSnapshot(const std::string& path)
+    {
+        SnapshotWriter writer;
+        writer.Write(SnapshotHeader{SnapshotWriter::Magic, SnapshotWriter::Version, Tick(), m_EntityManager.EndEntity(), m_EntityManager.m_FreeHead, m_EntityManager.m_FreeTail});
+        m_EntityManager.Save(writer);
+        m_ComponentManager.SaveSnapshot(writer);
+        return writer.WriteFile(path);
+    }
+    bool Storage::LoadSnapshot(const std::string& path)
+    {
+        SnapshotReader reader(path);
+        SnapshotHeader header = reader.Read<SnapshotHeader>();
+        if (!reader.Good() || header.Magic != SnapshotWriter::Magic || header.Version != SnapshotWriter::Version || m_EntityManager.EndEntity() != 0)
+        {
+            return false;
+        }
+        const uint32_t* generations = reader.ReadArray<uint32_t>(header.Entities);
+        const uint32_t* next        = reader.ReadArray<uint32_t>(header.Entities);
+        const uint64_t* alive       = reader.ReadArray<uint64_t>((header.Entities + 63) / 64);
+        uint32_t        count       = reader.Read<uint32_t>();
+
+        std::vector<SnapshotColumn> columns;
+        while (reader.Good() && columns.size() < count)
+        {
+            reader.ReadColumn(columns.emplace_back());
+        }
+        if (!reader.Good() || !EntityManager::Verify(next, alive, header.Entities, header.FreeHead, header.FreeTail) ||
+            !m_ComponentManager.LoadSnapshot(columns, header.Entities, header.Tick))
+        {
+            return false;
+        }
+        m_EntityManager.Restore(generations, next, alive, header.Entities, header.FreeHead, header.FreeTail);
+        Profiler::CountChanges(header.Entities);
+        return true;
+    }
+    template <typename... Components> void Storage::CopyTo(Storage& frame) const
+    {
+        const EntityManager& entities = m_EntityManager;
+        frame.m_EntityManager.Restore(entities.m_Generations.data(), entities.m_Next.data(), entities.m_Alive.data(), entities.m_Generations.size(), entities.m_FreeHead,
+                                      entities.m_FreeTail);
+        frame.m_ComponentManager.CopyFrom<Components...>(m_ComponentManager);
+    }
 
-    bool Storage::Valid(uint32_t id, uint32_t gen) const { return m_EntityManager.Valid(id, gen); }
+    bool   Storage::Valid(uint32_t id, uint32_t gen) const { return m_EntityManager.Valid(id, gen); }
+    Entity Storage::MakeEntity(uint32_t id, uint32_t gen)
+    {
+        Entity res;
+        res.m_ID      = id;
+        res.m_Gen     = gen;
+        res.m_Storage = this;
+        return res;
+    }
+    void Storage::Notify(Lifecycle kind, uint32_t component_id, uint32_t id)
+    {
+        if (m_ObserverManager.Observed(component_id))
+        {
+            m_ObserverManager.Record(kind, component_id, MakeEntity(id, m_EntityManager.Generation(id)));
+        }
+    }
     void Storage::Destroy(uint32_t id, uint32_t gen)
     {
         if (m_EntityManager.Valid(id, gen))
         {
+            if (m_ObserverManager.Active())
+            {
+                m_ComponentManager.EachComponent(id, [this, id](uint32_t component_id) { Notify(Lifecycle::Destroy, component_id, id); });
+            }
+            Unlink(id);
             m_EntityManager.Destroy(id);
             m_ComponentManager.Destroy(id);
+            Profiler::CountChanges(1);
         }
     }
 
-    template <typename ComponentType> ComponentType* Storage::AddComponent(uint32_t id, uint32_t gen, const ComponentType& component)
+    // Back to front, so the pool or archetype the ids were collected from shrinks from its end without moving anything.
+    template <typename... Components> uint32_t Storage::DestroyAll()
     {
-        return (m_EntityManager.Valid(id, gen) ? m_ComponentManager.AddComponent<ComponentType>(id, component) : nullptr);
+        const std::vector<uint32_t> ids = m_ComponentManager.Collect<Components...>();
+        for (auto it = ids.rbegin(); it != ids.rend(); ++it)
+        {
+            if (m_ObserverManager.Active())
+            {
+                m_ComponentManager.EachComponent(*it, [this, it](uint32_t component_id) { Notify(Lifecycle::Destroy, component_id, *it); });
+            }
+            Unlink(*it);
+            m_EntityManager.Destroy(*it);
+            m_ComponentManager.Destroy(*it);
+        }
+        Profiler::CountChanges(ids.size());
+        return ids.size();
+    }
+    // Removing every Hierarchy drops all links at once, so nothing is unlinked node by node.
+    template <typename ComponentType> uint32_t Storage::RemoveAll()
+    {
+        if (m_ObserverManager.Observed(ComponentTypeId::Get<ComponentType>()))
+        {
+            for (uint32_t id : m_ComponentManager.Collect<ComponentType>())
+            {
+                Notify(Lifecycle::Remove, ComponentTypeId::Get<ComponentType>(), id);
+            }
+        }
+        const uint32_t count = m_ComponentManager.RemoveAll<ComponentType>();
+        Profiler::CountChanges(count);
+        return count;
+    }
+
+    template <typename ComponentType, typename... Args> ComponentType* Storage::EmplaceComponent(uint32_t id, uint32_t gen, Args&&... args)
+    {
+        static_assert(!std::is_same_v<ComponentType, Hierarchy>, "Hierarchy links are set through Entity::SetParent");
+        if (!m_EntityManager.Valid(id, gen))
+        {
+            return nullptr;
+        }
+        Profiler::CountChanges(1);
+        if (m_ObserverManager.Observed(ComponentTypeId::Get<ComponentType>()) && !m_ComponentManager.HasComponent<ComponentType>(id))
+        {
+            Notify(Lifecycle::Add, ComponentTypeId::Get<ComponentType>(), id);
+        }
+        return m_ComponentManager.EmplaceComponent<ComponentType>(id, std::forward<Args>(args)...);
+    }
+    template <typename ComponentType, typename... Args> ComponentType* Storage::ReplaceComponent(uint32_t id, uint32_t gen, Args&&... args)
+    {
+        static_assert(!std::is_same_v<ComponentType, Hierarchy>, "Hierarchy links are set through Entity::SetParent");
+        if (!m_EntityManager.Valid(id, gen))
+        {
+            return nullptr;
+        }
+        ComponentType* res = m_ComponentManager.ReplaceComponent<ComponentType>(id, std::forward<Args>(args)...);
+        Profiler::CountChanges(res ? 1 : 0);
+        return res;
     }
     template <typename ComponentType> ComponentType* Storage::GetComponent(uint32_t id, uint32_t gen)
     {
-        return (m_EntityManager.Valid(id, gen) ? m_ComponentManager.GetComponent<ComponentType>(id) : nullptr);
+        if (!m_EntityManager.Valid(id, gen))
+        {
+            return nullptr;
+        }
+        if constexpr (std::is_const_v<ComponentType>)
+        {
+            return m_ComponentManager.ReadComponent<std::remove_const_t<ComponentType>>(id);
+        }
+        else
+        {
+            return m_ComponentManager.GetComponent<ComponentType>(id);
+        }
     }
     template <typename ComponentType> bool Storage::HasComponent(uint32_t id, uint32_t gen) const
     {
@@ -44,7 +387,134 @@ namespace ECS
     {
         if (m_EntityManager.Valid(id, gen))
         {
+            if constexpr (std::is_same_v<ComponentType, Hierarchy>)
+            {
+                Unlink(id);
+            }
+            if (m_ComponentManager.HasComponent<ComponentType>(id))
+            {
+                Notify(Lifecycle::Remove, ComponentTypeId::Get<ComponentType>(), id);
+            }
             m_ComponentManager.RemoveComponent<ComponentType>(id);
+            Profiler::CountChanges(1);
+        }
+    }
+    template <typename ComponentType, typename Func> bool Storage::PatchComponent(uint32_t id, uint32_t gen, Func& func)
+    {
+        ComponentType* component = GetComponent<ComponentType>(id, gen);
+        if (component)
+        {
+            func(*component);
+        }
+        return component != nullptr;
+    }
+    template <typename ComponentType> bool Storage::MarkChanged(uint32_t id, uint32_t gen) { return GetComponent<ComponentType>(id, gen) != nullptr; }
+
+    bool Storage::SetParent(uint32_t id, uint32_t gen, const Entity& parent)
+    {
+        if (!Valid(id, gen) || (parent.m_Storage && parent.m_Storage != this))
+        {
+            return false;
+        }
+        const uint32_t parent_id = (parent.Valid() ? parent.m_ID : EntityManager::Null);
+        for (uint32_t ancestor = parent_id; ancestor != EntityManager::Null;)
+        {
+            if (ancestor == id)
+            {
+                return false;
+            }
+            const Hierarchy* node = m_ComponentManager.ReadComponent<Hierarchy>(ancestor);
+            ancestor              = (node ? node->Parent : EntityManager::Null);
+        }
+        // Both nodes exist before any reference is taken, adding one may move the other.
+        if (parent_id != EntityManager::Null && !m_ComponentManager.HasComponent<Hierarchy>(parent_id))
+        {
+            m_ComponentManager.EmplaceComponent<Hierarchy>(parent_id);
+            Notify(Lifecycle::Add, ComponentTypeId::Get<Hierarchy>(), parent_id);
+        }
+        if (!m_ComponentManager.HasComponent<Hierarchy>(id))
+        {
+            m_ComponentManager.EmplaceComponent<Hierarchy>(id);
+            Notify(Lifecycle::Add, ComponentTypeId::Get<Hierarchy>(), id);
+        }
+        Detach(id);
+        uint32_t depth = 0;
+        if (parent_id != EntityManager::Null)
+        {
+            Hierarchy& node  = Node(id);
+            Hierarchy& above = Node(parent_id);
+            node.Parent      = parent_id;
+            node.NextSibling = above.FirstChild;
+            if (above.FirstChild != EntityManager::Null)
+            {
+                Node(above.FirstChild).PrevSibling = id;
+            }
+            above.FirstChild = id;
+            depth            = above.Depth + 1;
+        }
+        UpdateDepth(id, depth);
+        Profiler::CountChanges(1);
+        return true;
+    }
+    Entity Storage::Related(uint32_t id, uint32_t gen, uint32_t Hierarchy::*link)
+    {
+        const Hierarchy* node = (Valid(id, gen) ? m_ComponentManager.ReadComponent<Hierarchy>(id) : nullptr);
+        if (!node || node->*link == EntityManager::Null)
+        {
+            return Entity();
+        }
+        return MakeEntity(node->*link, m_EntityManager.Generation(node->*link));
+    }
+    Hierarchy& Storage::Node(uint32_t id) { return *m_ComponentManager.GetComponent<Hierarchy>(id); }
+    // Unlinks the node from its parent and siblings, its own children stay attached.
+    void Storage::Detach(uint32_t id)
+    {
+        Hierarchy& node = Node(id);
+        if (node.PrevSibling != EntityManager::Null)
+        {
+            Node(node.PrevSibling).NextSibling = node.NextSibling;
+        }
+        else if (node.Parent != EntityManager::Null)
+        {
+            Node(node.Parent).FirstChild = node.NextSibling;
+        }
+        if (node.NextSibling != EntityManager::Null)
+        {
+            Node(node.NextSibling).PrevSibling = node.PrevSibling;
+        }
+        node.Parent      = EntityManager::Null;
+        node.NextSibling = EntityManager::Null;
+        node.PrevSibling = EntityManager::Null;
+    }
+    // Takes the node out of the hierarchy before it goes away, its children become roots.
+    void Storage::Unlink(uint32_t id)
+    {
+        if (!m_ComponentManager.HasComponent<Hierarchy>(id))
+        {
+            return;
+        }
+        Detach(id);
+        for (uint32_t child = Node(id).FirstChild; child != EntityManager::Null;)
+        {
+            uint32_t next = Node(child).NextSibling;
+            Detach(child);
+            UpdateDepth(child, 0);
+            child = next;
+        }
+        Node(id).FirstChild = EntityManager::Null;
+    }
+    void Storage::UpdateDepth(uint32_t id, uint32_t depth)
+    {
+        std::vector<std::pair<uint32_t, uint32_t>> stack{{id, depth}};
+        while (!stack.empty())
+        {
+            auto [node, level] = stack.back();
+            stack.pop_back();
+            Node(node).Depth = level;
+            for (uint32_t child = Node(node).FirstChild; child != EntityManager::Null; child = Node(child).NextSibling)
+            {
+                stack.emplace_back(child, level + 1);
+            }
         }
     }
 
@@ -3,62 +3,653 @@
 namespace ECS
 {
 
-    template <typename... Components> StorageView<Components...>::Iterator::Iterator(uint32_t id, StorageView* v) : m_ID(id), m_View(v) {}
+    template <typename... Components>
+    ViewEntry<Components...>::ViewEntry(const Entity& entity, typename ViewElement<Components>::Type*... components) :
+        Entity(entity), m_Components(components...)
+    {
+    }
+    template <typename... Components> template <size_t I> decltype(auto) ViewEntry<Components...>::get() const
+    {
+        if constexpr (I == 0)
+        {
+            return static_cast<Entity>(*this);
+        }
+        else
+        {
+            return ViewElement<std::tuple_element_t<I - 1, std::tuple<Components...>>>::Pass(std::get<I - 1>(m_Components));
+        }
+    }
+
+    template <typename... Components>
+    StorageView<Components...>::Iterator::Iterator(uint32_t id, StorageView* v) : m_ID(id), m_Archetype(0), m_Row(0), m_View(v)
+    {
+    }
+    template <typename... Components>
+    StorageView<Components...>::Iterator::Iterator(uint32_t archetype, uint32_t row, StorageView* v) : m_ID(0), m_Archetype(archetype), m_Row(row), m_View(v)
+    {
+    }
 
     template <typename... Components> bool StorageView<Components...>::Iterator::operator==(const Iterator& other) const
     {
-        return m_View == other.m_View && m_ID == other.m_ID;
+        return m_View == other.m_View && m_ID == other.m_ID && m_Archetype == other.m_Archetype && m_Row == other.m_Row;
     }
     template <typename... Components> bool StorageView<Components...>::Iterator::operator!=(const Iterator& other) const
     {
-        return m_View != other.m_View || m_ID != other.m_ID;
+        return !(*this == other);
     }
 
-    template <typename... Components> StorageView<Components...>::StorageView(Storage* storage) : m_Storage(storage)
+    template <typename... Components>
+    StorageView<Components...>::StorageView(Storage* storage) :
+        m_Signature(RequiredSignature()), m_Pool(nullptr), m_Group(nullptr), m_Cached(false), m_Excluding(false), m_Since(0), m_Storage(storage)
     {
-        m_Signature = m_Storage->m_ComponentManager.BuildSignature<Components...>();
+        static const SparseSet empty;
+
+        ComponentManager& manager = m_Storage->m_ComponentManager;
+        if (manager.Mode() == StorageMode::Archetype)
+        {
+            m_Archetypes = manager.m_ArchetypeManager.Matching(m_Signature);
+            for (Archetype* archetype : m_Archetypes)
+            {
+                m_Columns.push_back({archetype->ColumnIndex(ComponentTypeId::Get<Component<Components>>())...});
+            }
+            return;
+        }
+        m_Pools = {manager.GetComponentArray<Component<Components>>()...};
+        if constexpr (Required != 0)
+        {
+            // Group members lead every owned pool in the same order, so any of the required pools drives the zip.
+            if (const OwningGroup* group = manager.FindGroup(m_Signature))
+            {
+                m_Pool  = std::get<Lead()>(m_Pools);
+                m_Group = group;
+                return;
+            }
+            if (Query* query = manager.FindQuery(m_Signature))
+            {
+                m_Pool   = query;
+                m_Cached = true;
+                return;
+            }
+            // Drive iteration from the smallest pool, the other components are checked through the signature. Tags have no
+            // pool, views of tags alone scan the entities. Optional components never drive.
+            for (auto [pool, skip] : {std::pair<const IComponentArray*, bool>(manager.GetComponentArray<Component<Components>>(),
+                                                                              IsTag<Component<Components>> || !ViewElement<Components>::Required)...})
+            {
+                if (skip)
+                {
+                    continue;
+                }
+                if (!pool)
+                {
+                    m_Pool = &empty;
+                    break;
+                }
+                if (!m_Pool || pool->Size() < m_Pool->Size())
+                {
+                    m_Pool = pool;
+                }
+            }
+        }
     }
     template <typename... Components> typename StorageView<Components...>::Iterator StorageView<Components...>::begin()
     {
-        Iterator res(m_Storage->m_EntityManager.BeginEntity(), this);
-        if (!m_Storage->m_ComponentManager.Matches(res.m_ID, m_Signature))
+        Iterator res(0, this);
+        if (m_Storage->m_ComponentManager.Mode() == StorageMode::Archetype)
         {
-            ++res;
+            res = Iterator(0, 0, this);
         }
+        else if (!m_Pool)
+        {
+            res = Iterator(m_Storage->m_EntityManager.BeginEntity(), this);
+        }
+        res.Settle();
         return res;
     }
     template <typename... Components> typename StorageView<Components...>::Iterator StorageView<Components...>::end()
     {
-        return Iterator(m_Storage->m_EntityManager.EndEntity(), this);
+        if (m_Storage->m_ComponentManager.Mode() == StorageMode::Archetype)
+        {
+            return Iterator(m_Archetypes.size(), 0, this);
+        }
+        return Iterator(m_Pool ? PoolEnd() : m_Storage->m_EntityManager.EndEntity(), this);
     }
     template <typename... Components> bool StorageView<Components...>::Empty() { return begin() == end(); }
 
-    template <typename... Components> typename StorageView<Components...>::Iterator& StorageView<Components...>::Iterator::operator++()
+    template <typename... Components> template <typename ComponentType> StorageView<Components...>& StorageView<Components...>::Added() &
+    {
+        m_Filters.push_back({ComponentTypeId::Get<ComponentType>(), true});
+        return *this;
+    }
+    template <typename... Components> template <typename ComponentType> StorageView<Components...>& StorageView<Components...>::Changed() &
+    {
+        m_Filters.push_back({ComponentTypeId::Get<ComponentType>(), false});
+        return *this;
+    }
+    template <typename... Components> StorageView<Components...>& StorageView<Components...>::Since(uint32_t tick) &
+    {
+        m_Since = tick;
+        return *this;
+    }
+    template <typename... Components> template <typename ComponentType> StorageView<Components...> StorageView<Components...>::Added() &&
     {
-        do
+        return std::move(Added<ComponentType>());
+    }
+    template <typename... Components> template <typename ComponentType> StorageView<Components...> StorageView<Components...>::Changed() &&
+    {
+        return std::move(Changed<ComponentType>());
+    }
+    template <typename... Components> StorageView<Components...> StorageView<Components...>::Since(uint32_t tick) && { return std::move(Since(tick)); }
+    template <typename... Components> template <typename... Excluded> StorageView<Components...>& StorageView<Components...>::Exclude() &
+    {
+        (m_Excluded.Set(ComponentTypeId::Get<Excluded>(), true), ...);
+        if (m_Storage->m_ComponentManager.Mode() != StorageMode::Archetype)
         {
-            m_ID = m_View->m_Storage->m_EntityManager.NextEntity(m_ID);
+            m_Excluding = true;
+            return *this;
+        }
+        for (size_t i = m_Archetypes.size(); i-- > 0;)
+        {
+            if (m_Archetypes[i]->GetSignature().Intersects(m_Excluded))
+            {
+                m_Archetypes.erase(m_Archetypes.begin() + i);
+                m_Columns.erase(m_Columns.begin() + i);
+            }
         }
-        while (m_ID != m_View->m_Storage->m_EntityManager.EndEntity() && !m_View->m_Storage->m_ComponentManager.Matches(m_ID, m_View->m_Signature));
+        return *this;
+    }
+    template <typename... Components> template <typename... Excluded> StorageView<Components...> StorageView<Components...>::Exclude() &&
+    {
+        return std::move(Exclude<Excluded...>());
+    }
+
+    template <typename... Components> typename StorageView<Components...>::Iterator& StorageView<Components...>::Iterator::operator++()
+    {
+        Advance();
         return *this;
     }
     template <typename... Components> typename StorageView<Components...>::Iterator StorageView<Components...>::Iterator::operator++(int)
     {
         auto res = *this;
-        do
+        Advance();
+        return res;
+    }
+    template <typename... Components> ViewEntry<Components...> StorageView<Components...>::Iterator::operator*()
+    {
+        Profiler::CountVisits(1);
+        if (m_View->m_Storage->m_ComponentManager.Mode() == StorageMode::Archetype)
+        {
+            return m_View->Fetch(m_Archetype, m_Row, std::index_sequence_for<Components...>());
+        }
+        return m_View->Fetch(m_View->m_Pool ? m_View->m_Pool->Entities()[m_ID] : m_ID, std::index_sequence_for<Components...>());
+    }
+    template <typename... Components> void StorageView<Components...>::Iterator::Advance()
+    {
+        if (m_View->m_Storage->m_ComponentManager.Mode() == StorageMode::Archetype)
+        {
+            ++m_Row;
+        }
+        else if (m_View->m_Pool)
+        {
+            ++m_ID;
+        }
+        else
         {
             m_ID = m_View->m_Storage->m_EntityManager.NextEntity(m_ID);
         }
-        while (m_ID != m_View->m_Storage->m_EntityManager.EndEntity() && m_View->m_Storage->m_ComponentManager.Matches(m_ID, m_View->m_Signature));
+        Settle();
+    }
+    template <typename... Components> void StorageView<Components...>::Iterator::Settle()
+    {
+        const Storage* storage = m_View->m_Storage;
+        if (storage->m_ComponentManager.Mode() == StorageMode::Archetype)
+        {
+            while (m_Archetype < m_View->m_Archetypes.size())
+            {
+                const Archetype& archetype = *m_View->m_Archetypes[m_Archetype];
+                while (m_Row < archetype.Size() && !m_View->Passes(archetype.Entities()[m_Row]))
+                {
+                    ++m_Row;
+                }
+                if (m_Row < archetype.Size())
+                {
+                    break;
+                }
+                ++m_Archetype;
+                m_Row = 0;
+            }
+        }
+        else if (m_View->m_Pool)
+        {
+            const auto&    entities = m_View->m_Pool->Entities();
+            const bool     matched  = Required == 1 || m_View->m_Cached || m_View->m_Group;
+            const uint32_t end      = m_View->PoolEnd();
+            while (m_ID < end && ((!matched && !storage->m_ComponentManager.Matches(entities[m_ID], m_View->m_Signature)) || !m_View->Passes(entities[m_ID])))
+            {
+                ++m_ID;
+            }
+        }
+        else if constexpr (Required != 0)
+        {
+            const uint32_t end = storage->m_EntityManager.EndEntity();
+            for (m_ID = storage->m_ComponentManager.m_Matrix.Next(m_View->m_Signature, m_ID, end); m_ID != end && !m_View->Passes(m_ID);)
+            {
+                m_ID = storage->m_ComponentManager.m_Matrix.Next(m_View->m_Signature, m_ID + 1, end);
+            }
+        }
+        else
+        {
+            while (m_ID != storage->m_EntityManager.EndEntity() && !m_View->Passes(m_ID))
+            {
+                m_ID = storage->m_EntityManager.NextEntity(m_ID);
+            }
+        }
+    }
+
+    // Resolves pools and archetype columns once, so the callback receives references without per-entity lookups.
+    template <typename... Components> template <typename Func> void StorageView<Components...>::Each(Func func)
+    {
+        uint32_t visited = 0;
+        if (m_Storage->m_ComponentManager.Mode() == StorageMode::Archetype)
+        {
+            for (size_t i = 0; i < m_Archetypes.size(); ++i)
+            {
+                visited += EachRows(func, *m_Archetypes[i], m_Columns[i], 0, m_Archetypes[i]->Size(), std::index_sequence_for<Components...>());
+            }
+        }
+        else if (!m_Pool)
+        {
+            visited = EachScan(func, 0, m_Storage->m_EntityManager.EndEntity(), std::index_sequence_for<Components...>());
+        }
+        else if constexpr (Required != 0)
+        {
+            if (m_Group)
+            {
+                visited = EachGroup(func, 0, PoolEnd(), std::index_sequence_for<Components...>());
+            }
+            else if (m_Pool->Size() != 0)
+            {
+                visited = EachPool(func, 0, m_Pool->Size(), std::index_sequence_for<Components...>());
+            }
+        }
+        Profiler::CountVisits(visited);
+    }
+    // Tasks cover disjoint ranges of the view, so every entity is visited by exactly one thread.
+    template <typename... Components> template <typename Func> void StorageView<Components...>::ParallelEach(Func func, uint32_t grain, ThreadPool* pool)
+    {
+        ThreadPool&         workers  = (pool ? *pool : ThreadPool::Shared());
+        Profiler::Counters* counters = Profiler::Current();
+        TaskGroup           group;
+        grain               = std::max<uint32_t>(grain, 1);
+        if (m_Storage->m_ComponentManager.Mode() == StorageMode::Archetype)
+        {
+            for (size_t i = 0; i < m_Archetypes.size(); ++i)
+            {
+                // Tasks are cut at chunk boundaries so no chunk is shared between threads.
+                uint32_t capacity = m_Archetypes[i]->ChunkCapacity();
+                uint32_t step     = (grain + capacity - 1) / capacity * capacity;
+                for (uint32_t begin = 0; begin < m_Archetypes[i]->Size(); begin += step)
+                {
+                    uint32_t end = std::min(begin + step, m_Archetypes[i]->Size());
+                    workers.Submit(group,
+                                   [this, &func, counters, i, begin, end]
+                                   {
+                                       Profiler::Adopt adopt(counters);
+                                       Profiler::CountVisits(EachRows(func, *m_Archetypes[i], m_Columns[i], begin, end, std::index_sequence_for<Components...>()));
+                                   });
+                }
+            }
+        }
+        else if (!m_Pool)
+        {
+            for (uint32_t begin = 0; begin < m_Storage->m_EntityManager.EndEntity(); begin += grain)
+            {
+                uint32_t end = std::min(begin + grain, m_Storage->m_EntityManager.EndEntity());
+                workers.Submit(group,
+                               [this, &func, counters, begin, end]
+                               {
+                                   Profiler::Adopt adopt(counters);
+                                   Profiler::CountVisits(EachScan(func, begin, end, std::index_sequence_for<Components...>()));
+                               });
+            }
+        }
+        else if constexpr (Required != 0)
+        {
+            for (uint32_t begin = 0; begin < PoolEnd(); begin += grain)
+            {
+                uint32_t end = std::min(begin + grain, PoolEnd());
+                workers.Submit(group,
+                               [this, &func, counters, begin, end]
+                               {
+                                   Profiler::Adopt adopt(counters);
+                                   Profiler::CountVisits(m_Group ? EachGroup(func, begin, end, std::index_sequence_for<Components...>())
+                                                                 : EachPool(func, begin, end, std::index_sequence_for<Components...>()));
+                               });
+            }
+        }
+        workers.Wait(group);
+    }
+
+    template <typename... Components> const Signature& StorageView<Components...>::RequiredSignature()
+    {
+        static const Signature signature = []
+        {
+            Signature res;
+            ((ViewElement<Components>::Required ? res.Set(ComponentTypeId::Get<Component<Components>>(), true) : void()), ...);
+            return res;
+        }();
+        return signature;
+    }
+    template <typename... Components> constexpr size_t StorageView<Components...>::Lead()
+    {
+        constexpr bool required[] = {ViewElement<Components>::Required...};
+        size_t         res        = 0;
+        while (!required[res])
+        {
+            ++res;
+        }
         return res;
     }
-    template <typename... Components> Entity StorageView<Components...>::Iterator::operator*()
+    template <typename... Components> bool StorageView<Components...>::Passes(uint32_t id) const
+    {
+        if (m_Excluding && m_Storage->m_ComponentManager.m_Signatures[id].Intersects(m_Excluded))
+        {
+            return false;
+        }
+        for (const Filter& filter : m_Filters)
+        {
+            const ComponentTicks* ticks = m_Storage->m_ComponentManager.Ticks(id, filter.ComponentId);
+            if (!ticks || (filter.Added ? ticks->Added : ticks->Changed) <= m_Since)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    template <typename... Components> Entity StorageView<Components...>::MakeEntity(uint32_t id) const
     {
         Entity res;
-        res.m_ID      = m_ID;
-        res.m_Gen     = m_View->m_Storage->m_EntityManager.Generation(m_ID);
-        res.m_Storage = m_View->m_Storage;
+        res.m_ID      = id;
+        res.m_Gen     = m_Storage->m_EntityManager.Generation(id);
+        res.m_Storage = m_Storage;
         return res;
     }
+    template <typename... Components>
+    template <typename Func>
+    void StorageView<Components...>::Invoke(Func& func, uint32_t id, Component<Components>*... components) const
+    {
+        if constexpr (std::is_invocable_v<Func&, Entity, typename ViewElement<Components>::Argument...>)
+        {
+            func(MakeEntity(id), ViewElement<Components>::Pass(components)...);
+        }
+        else
+        {
+            func(ViewElement<Components>::Pass(components)...);
+        }
+    }
+    template <typename... Components>
+    template <typename Func>
+    void StorageView<Components...>::Visit(Func& func, uint32_t id, uint32_t tick, Component<Components>*... components) const
+    {
+        Invoke(func, id, components...);
+        if constexpr (Writes)
+        {
+            std::apply([&](auto*... pools) { (Touch<Components>(pools, components, tick), ...); }, m_Pools);
+        }
+    }
+    template <typename... Components>
+    template <typename Func, size_t... I>
+    uint32_t StorageView<Components...>::EachScan(Func& func, uint32_t begin, uint32_t end, std::index_sequence<I...>) const
+    {
+        const uint32_t tick    = m_Storage->Tick();
+        uint32_t       visited = 0;
+        if constexpr (TagsOnly)
+        {
+            // Views of tags only: the matrix hands out the matching entities directly.
+            m_Storage->m_ComponentManager.m_Matrix.Each(m_Signature, begin, end,
+                                                        [&](uint32_t id)
+                                                        {
+                                                            if (Passes(id))
+                                                            {
+                                                                Visit(func, id, tick, Find<Components>(std::get<I>(m_Pools), id)...);
+                                                                ++visited;
+                                                            }
+                                                        });
+        }
+        else if constexpr (Required == 0)
+        {
+            const EntityManager& entities = m_Storage->m_EntityManager;
+            for (uint32_t id = (entities.Alive(begin) ? begin : entities.NextEntity(begin)); id < end; id = entities.NextEntity(id))
+            {
+                if (Passes(id))
+                {
+                    Visit(func, id, tick, Find<Components>(std::get<I>(m_Pools), id)...);
+                    ++visited;
+                }
+            }
+        }
+        return visited;
+    }
+    template <typename... Components>
+    template <typename Func, size_t... I>
+    uint32_t StorageView<Components...>::EachRows(Func& func, Archetype& archetype, const Columns& columns, uint32_t begin, uint32_t end, std::index_sequence<I...>) const
+    {
+        const uint32_t* entities = archetype.Entities().data();
+        const uint32_t  tick     = m_Storage->Tick();
+        uint32_t        visited  = 0;
+        while (begin < end)
+        {
+            // Rows of one chunk are contiguous in every column.
+            uint32_t                   count = std::min(end - begin, archetype.ChunkCapacity() - begin % archetype.ChunkCapacity());
+            std::tuple<Component<Components>*...> data(Find<Components>(archetype, columns[I], begin)...);
+            // Tags stay on their instance and absent optional columns on nullptr, every other column advances by row.
+            auto at = [&data](auto index, uint32_t row)
+            {
+                using Element = std::tuple_element_t<decltype(index)::value, std::tuple<Components...>>;
+                auto* column  = std::get<decltype(index)::value>(data);
+                return (IsTag<Component<Element>> || (!ViewElement<Element>::Required && !column) ? column : column + row);
+            };
+            if (m_Filters.empty())
+            {
+                for (uint32_t row = 0; row < count; ++row)
+                {
+                    Invoke(func, entities[begin + row], at(std::integral_constant<size_t, I>(), row)...);
+                }
+                (Touch<Components>(archetype, columns[I], begin, count, tick), ...);
+                visited += count;
+            }
+            else
+            {
+                for (uint32_t row = 0; row < count; ++row)
+                {
+                    if (Passes(entities[begin + row]))
+                    {
+                        Invoke(func, entities[begin + row], at(std::integral_constant<size_t, I>(), row)...);
+                        (Touch<Components>(archetype, columns[I], begin + row, 1, tick), ...);
+                        ++visited;
+                    }
+                }
+            }
+            begin += count;
+        }
+        return visited;
+    }
+    template <typename... Components>
+    template <typename Func, size_t... I>
+    uint32_t StorageView<Components...>::EachPool(Func& func, uint32_t begin, uint32_t end, std::index_sequence<I...>) const
+    {
+        const ComponentManager&                 manager  = m_Storage->m_ComponentManager;
+        const auto&                             entities = m_Pool->Entities();
+        std::tuple<Component<Components>*...>   data((std::get<I>(m_Pools) ? std::get<I>(m_Pools)->Data() : nullptr)...);
+        std::array<bool, sizeof...(Components)> driving{(std::get<I>(m_Pools) == m_Pool)...};
+        const uint32_t                          tick    = m_Storage->Tick();
+        uint32_t                                visited = 0;
+        auto                                    visit   = [&](uint32_t i, bool filtered)
+        {
+            if constexpr (Required > 1)
+            {
+                if (!m_Cached && !manager.Matches(entities[i], m_Signature))
+                {
+                    return;
+                }
+            }
+            if (filtered && !Passes(entities[i]))
+            {
+                return;
+            }
+            Visit(func, entities[i], tick, (driving[I] ? std::get<I>(data) + i : Find<Components>(std::get<I>(m_Pools), entities[i]))...);
+            ++visited;
+        };
+        // Separate loops keep the unfiltered one free of the filter test.
+        if (m_Filters.empty() && !m_Excluding)
+        {
+            for (uint32_t i = begin; i < end; ++i)
+            {
+                visit(i, false);
+            }
+        }
+        else
+        {
+            for (uint32_t i = begin; i < end; ++i)
+            {
+                visit(i, true);
+            }
+        }
+        return visited;
+    }
+    // Group members share their position in every owned pool, the loop is a plain zip over the dense arrays.
+    template <typename... Components>
+    template <typename Func, size_t... I>
+    uint32_t StorageView<Components...>::EachGroup(Func& func, uint32_t begin, uint32_t end, std::index_sequence<I...>) const
+    {
+        const uint32_t*                       entities = m_Pool->Entities().data();
+        std::tuple<Component<Components>*...> data((ViewElement<Components>::Required ? std::get<I>(m_Pools)->Data() : nullptr)...);
+        const uint32_t                        tick = m_Storage->Tick();
+        // Optional components are outside the group and looked up.
+        auto at = [this, &data, entities](auto index, uint32_t i)
+        {
+            using Element = std::tuple_element_t<decltype(index)::value, std::tuple<Components...>>;
+            return (ViewElement<Element>::Required ? std::get<decltype(index)::value>(data) + i : Find<Element>(std::get<decltype(index)::value>(m_Pools), entities[i]));
+        };
+        if (m_Filters.empty() && !m_Excluding)
+        {
+            for (uint32_t i = begin; i < end; ++i)
+            {
+                Visit(func, entities[i], tick, at(std::integral_constant<size_t, I>(), i)...);
+            }
+            return end - begin;
+        }
+        uint32_t visited = 0;
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            if (Passes(entities[i]))
+            {
+                Visit(func, entities[i], tick, at(std::integral_constant<size_t, I>(), i)...);
+                ++visited;
+            }
+        }
+        return visited;
+    }
+    template <typename... Components> uint32_t StorageView<Components...>::PoolEnd() const { return (m_Group ? m_Group->Size() : m_Pool->Size()); }
+    template <typename... Components>
+    template <size_t... I>
+    ViewEntry<Components...> StorageView<Components...>::Fetch(uint32_t id, std::index_sequence<I...>) const
+    {
+        std::tuple<Component<Components>*...> components(Find<Components>(std::get<I>(m_Pools), id)...);
+        if constexpr (Writes)
+        {
+            (Touch<Components>(std::get<I>(m_Pools), std::get<I>(components), m_Storage->Tick()), ...);
+        }
+        return ViewEntry<Components...>(MakeEntity(id), std::get<I>(components)...);
+    }
+    template <typename... Components>
+    template <size_t... I>
+    ViewEntry<Components...> StorageView<Components...>::Fetch(uint32_t archetype, uint32_t row, std::index_sequence<I...>) const
+    {
+        if constexpr (Writes)
+        {
+            (Touch<Components>(*m_Archetypes[archetype], m_Columns[archetype][I], row, 1, m_Storage->Tick()), ...);
+        }
+        return ViewEntry<Components...>(MakeEntity(m_Archetypes[archetype]->Entities()[row]),
+                                        Find<Components>(*m_Archetypes[archetype], m_Columns[archetype][I], row)...);
+    }
+    template <typename... Components>
+    template <typename Element>
+    typename StorageView<Components...>::template Component<Element>* StorageView<Components...>::Find(ComponentArray<Component<Element>>* pool, uint32_t id)
+    {
+        if constexpr (IsTag<Component<Element>>)
+        {
+            return TagInstance<Component<Element>>();
+        }
+        else if constexpr (!ViewElement<Element>::Required)
+        {
+            uint32_t index = (pool ? pool->Index(id) : SparseSet::None);
+            return (index == SparseSet::None ? nullptr : pool->Data() + index);
+        }
+        else
+        {
+            return pool->Data() + pool->Index(id);
+        }
+    }
+    template <typename... Components>
+    template <typename Element>
+    typename StorageView<Components...>::template Component<Element>* StorageView<Components...>::Find(Archetype& archetype, int32_t column, uint32_t row)
+    {
+        if constexpr (IsTag<Component<Element>>)
+        {
+            return TagInstance<Component<Element>>();
+        }
+        else
+        {
+            if (!ViewElement<Element>::Required && column == -1)
+            {
+                return nullptr;
+            }
+            return reinterpret_cast<Component<Element>*>(archetype.At(column, row));
+        }
+    }
 
-}  // namespace ECS
\ No newline at end of file
+    template <typename... Components>
+    template <typename Element>
+    void StorageView<Components...>::Touch(ComponentArray<Component<Element>>* pool, Component<Element>* component, uint32_t tick)
+    {
+        if constexpr (ViewElement<Element>::Writes)
+        {
+            if (component)
+            {
+                pool->TicksAt(component - pool->Data())->Changed = tick;
+            }
+        }
+    }
+    template <typename... Components>
+    template <typename Element>
+    void StorageView<Components...>::Touch(Archetype& archetype, int32_t column, uint32_t row, uint32_t count, uint32_t tick)
+    {
+        if constexpr (ViewElement<Element>::Writes)
+        {
+            if (column != -1)
+            {
+                ComponentTicks* ticks = archetype.TicksAt(column, row);
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    ticks[i].Changed = tick;
+                }
+            }
+        }
+    }
+
+}  // namespace ECS
+
+namespace std
+{
+    template <typename... Components> struct tuple_size<ECS::ViewEntry<Components...>> : integral_constant<size_t, sizeof...(Components) + 1>
+    {
+    };
+    template <typename... Components> struct tuple_element<0, ECS::ViewEntry<Components...>>
+    {
+        using type = ECS::Entity;
+    };
+    template <size_t I, typename... Components> struct tuple_element<I, ECS::ViewEntry<Components...>>
+    {
+        using type = typename ECS::ViewElement<tuple_element_t<I - 1, tuple<Components...>>>::Argument;
+    };
+}  // namespace std
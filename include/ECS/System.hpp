@@ -2,6 +2,26 @@
 
 namespace ECS
 {
-    template <typename... Components> StorageView<Components...> System::View() { return m_Storage->View<Components...>(); }
-    void                                                         System::Bind(Storage* storage) { m_Storage = storage; }
+    template <typename... Components> StorageView<Components...> System::View() { return m_Storage->View<Components...>().Since(m_LastRun); }
+    template <typename... Components> void                       System::Reads()
+    {
+        (m_Reads.Set(ComponentTypeId::Get<Components>(), true), ...);
+        m_Declared = true;
+    }
+    template <typename... Components> void System::Writes()
+    {
+        (m_Writes.Set(ComponentTypeId::Get<Components>(), true), ...);
+        m_Declared = true;
+    }
+    CommandBuffer&                                 System::Commands() { return m_Storage->Commands(); }
+    template <typename ResourceType> ResourceType* System::GetResource() { return m_Storage->GetResource<ResourceType>(); }
+    void           System::Bind(Storage* storage) { m_Storage = storage; }
+    bool System::Conflicts(const System& other) const
+    {
+        if (!m_Declared || !other.m_Declared)
+        {
+            return true;
+        }
+        return m_Writes.Intersects(other.m_Reads) || m_Writes.Intersects(other.m_Writes) || other.m_Writes.Intersects(m_Reads);
+    }
 }  // namespace ECS
\ No newline at end of file
@@ -2,23 +2,180 @@
 
 namespace ECS
 {
-    SystemManager::SystemManager(Storage* storage) { m_Storage = storage; }
+    SystemManager::SystemManager(Storage* storage) : m_Dirty(false), m_Mode(ExecutionMode::Serial), m_ThreadPool(nullptr), m_Storage(storage) {}
     void SystemManager::Update(float dt)
     {
-        for (auto& system : m_Systems)
+        if (m_Dirty)
         {
-            system->Update(dt);
+            BuildGraph();
         }
+        if (m_Mode == ExecutionMode::Parallel && m_Systems.size() > 1)
+        {
+            RunParallel(dt);
+        }
+        else
+        {
+            for (uint32_t index : m_Order)
+            {
+                RunSystem(index, dt);
+            }
+        }
+        m_Storage->FlushCommands();
+        m_Storage->FlushEvents();
+    }
+    template <typename Before, typename After> bool SystemManager::AddDependency()
+    {
+        const uint32_t before = SystemTypeId::Get<Before>();
+        const uint32_t after  = SystemTypeId::Get<After>();
+        // The dependency closes a cycle when Before already runs after After.
+        std::vector<uint32_t> stack = {after};
+        std::vector<bool>     seen(SystemTypeId::Count(), false);
+        while (!stack.empty())
+        {
+            uint32_t current = stack.back();
+            stack.pop_back();
+            if (current == before)
+            {
+                return false;
+            }
+            for (const auto& [from, to] : m_Dependencies)
+            {
+                if (from == current && !seen[to])
+                {
+                    seen[to] = true;
+                    stack.push_back(to);
+                }
+            }
+        }
+        m_Dependencies.emplace_back(before, after);
+        m_Dirty = true;
+        return true;
     }
-    template <typename Before, typename After> void SystemManager::AddDependency() {}
-    template <typename SystemType> void             SystemManager::RegisterSystem()
+    template <typename SystemType> void SystemManager::RegisterSystem()
     {
-        if (m_SystemId.find(INDEX(SystemType)) == m_SystemId.end())
+        const uint32_t system_id = SystemTypeId::Get<SystemType>();
+        if (m_SystemId.size() <= system_id)
+        {
+            m_SystemId.resize(system_id + 1, UINT32_MAX);
+        }
+        if (m_SystemId[system_id] == UINT32_MAX)
         {
-            size_t sz                     = m_SystemId.size();
-            m_SystemId[INDEX(SystemType)] = sz;
+            m_SystemId[system_id] = m_Systems.size();
             m_Systems.push_back(std::make_shared<SystemType>());
             m_Systems.back()->Bind(m_Storage);
+            m_Dirty = true;
         }
     }
-}  // namespace ECS
+    void SystemManager::SetExecutionMode(ExecutionMode mode, ThreadPool* pool)
+    {
+        m_Mode       = mode;
+        m_ThreadPool = pool;
+        if (m_Mode == ExecutionMode::Parallel && !m_ThreadPool)
+        {
+            m_ThreadPool = &ThreadPool::Shared();
+        }
+    }
+#ifdef ECS_PROFILE
+    Profiler& SystemManager::GetProfiler() { return m_Profiler; }
+#endif
+
+    // The serial order is the topological order of the explicit dependencies that prefers earlier registered systems,
+    // AddDependency refuses the ones that would close a cycle. Conflicting systems are then chained in serial order.
+    void SystemManager::BuildGraph()
+    {
+        const uint32_t size = m_Systems.size();
+        m_DependencyGraph.assign(size, {});
+        m_InDegree.assign(size, 0);
+        auto link = [this](uint32_t before, uint32_t after)
+        {
+            if (std::find(m_DependencyGraph[before].begin(), m_DependencyGraph[before].end(), after) == m_DependencyGraph[before].end())
+            {
+                m_DependencyGraph[before].push_back(after);
+                ++m_InDegree[after];
+            }
+        };
+        for (const auto& [before, after] : m_Dependencies)
+        {
+            if (std::max(before, after) < m_SystemId.size() && m_SystemId[before] != UINT32_MAX && m_SystemId[after] != UINT32_MAX)
+            {
+                link(m_SystemId[before], m_SystemId[after]);
+            }
+        }
+
+        std::vector<uint32_t>                                                        in_degree = m_InDegree;
+        std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> ready;
+        m_Order.clear();
+        for (uint32_t i = 0; i < size; ++i)
+        {
+            if (in_degree[i] == 0)
+            {
+                ready.push(i);
+            }
+        }
+        while (!ready.empty())
+        {
+            uint32_t index = ready.top();
+            ready.pop();
+            m_Order.push_back(index);
+            for (uint32_t next : m_DependencyGraph[index])
+            {
+                if (--in_degree[next] == 0)
+                {
+                    ready.push(next);
+                }
+            }
+        }
+        assert(m_Order.size() == size && "System dependencies form a cycle");
+
+        for (uint32_t i = 0; i < size; ++i)
+        {
+            for (uint32_t j = i + 1; j < size; ++j)
+            {
+                if (m_Systems[m_Order[i]]->Conflicts(*m_Systems[m_Order[j]]))
+                {
+                    link(m_Order[i], m_Order[j]);
+                }
+            }
+        }
+        m_Remaining = std::make_unique<std::atomic<uint32_t>[]>(size);
+        m_Dirty     = false;
+    }
+    void SystemManager::RunParallel(float dt)
+    {
+        for (uint32_t i = 0; i < m_Systems.size(); ++i)
+        {
+            m_Remaining[i].store(m_InDegree[i], std::memory_order_relaxed);
+        }
+        TaskGroup                     group;
+        std::function<void(uint32_t)> run = [&](uint32_t index)
+        {
+            RunSystem(index, dt);
+            for (uint32_t next : m_DependencyGraph[index])
+            {
+                if (m_Remaining[next].fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    m_ThreadPool->Submit(group, [&run, next] { run(next); });
+                }
+            }
+        };
+        for (uint32_t i = 0; i < m_Systems.size(); ++i)
+        {
+            if (m_InDegree[i] == 0)
+            {
+                m_ThreadPool->Submit(group, [&run, i] { run(i); });
+            }
+        }
+        m_ThreadPool->Wait(group);
+    }
+    void SystemManager::RunSystem(uint32_t index, float dt)
+    {
+#ifdef ECS_PROFILE
+        m_Profiler.Run(index, *m_Systems[index], dt);
+#else
+        m_Systems[index]->Update(dt);
+#endif
+        // Systems that could have written what this one reads are ordered around it, so every write it should see next time
+        // is stamped with a later tick.
+        m_Systems[index]->m_LastRun = m_Storage->AdvanceTick();
+    }
+}  // namespace ECS
\ No newline at end of file
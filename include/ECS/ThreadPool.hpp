@@ -0,0 +1,129 @@
+#pragma once
+
+namespace ECS
+{
+
+    bool TaskGroup::Done() const { return m_Remaining.load(std::memory_order_acquire) == 0; }
+
+    ThreadPool::ThreadPool(uint32_t workers)
+    {
+        // The last queue is shared by threads that do not belong to the pool.
+        for (uint32_t i = 0; i <= workers; ++i)
+        {
+            m_Queues.push_back(std::make_unique<Queue>());
+        }
+        for (uint32_t i = 0; i < workers; ++i)
+        {
+            m_Threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+        }
+    }
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_SleepMutex);
+            m_Stop = true;
+        }
+        m_Wake.notify_all();
+        for (auto& thread : m_Threads)
+        {
+            thread.join();
+        }
+    }
+
+    uint32_t ThreadPool::Workers() const { return m_Threads.size(); }
+    void     ThreadPool::Submit(TaskGroup& group, std::function<void()> task)
+    {
+        group.m_Remaining.fetch_add(1, std::memory_order_relaxed);
+        Queue& queue = *m_Queues[CurrentQueue()];
+        {
+            std::lock_guard<std::mutex> lock(queue.Mutex);
+            queue.Tasks.push_back({std::move(task), &group});
+        }
+        m_Pending.fetch_add(1, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(m_SleepMutex);
+        }
+        m_Wake.notify_one();
+    }
+    void ThreadPool::Wait(TaskGroup& group)
+    {
+        uint32_t queue = CurrentQueue();
+        while (!group.Done())
+        {
+            if (TryRun(queue))
+            {
+                continue;
+            }
+            // The group's last tasks run elsewhere: sleep until one finishes it or new work is queued.
+            std::unique_lock<std::mutex> lock(m_SleepMutex);
+            m_Wake.wait(lock, [this, &group] { return group.Done() || m_Pending.load(std::memory_order_acquire) != 0; });
+        }
+    }
+    ThreadPool& ThreadPool::Shared()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    bool ThreadPool::TryRun(uint32_t queue)
+    {
+        Task task;
+        bool found = false;
+        {
+            Queue&                      own = *m_Queues[queue];
+            std::lock_guard<std::mutex> lock(own.Mutex);
+            if (!own.Tasks.empty())
+            {
+                task = std::move(own.Tasks.back());
+                own.Tasks.pop_back();
+                found = true;
+            }
+        }
+        for (uint32_t i = 1; !found && i < m_Queues.size(); ++i)
+        {
+            Queue&                      victim = *m_Queues[(queue + i) % m_Queues.size()];
+            std::lock_guard<std::mutex> lock(victim.Mutex);
+            if (!victim.Tasks.empty())
+            {
+                task = std::move(victim.Tasks.front());
+                victim.Tasks.pop_front();
+                found = true;
+            }
+        }
+        if (!found)
+        {
+            return false;
+        }
+        m_Pending.fetch_sub(1, std::memory_order_relaxed);
+        task.Function();
+        if (task.Group->m_Remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            // Wakes the threads parked in Wait. The group may be gone once the count drops, only the pool is touched.
+            {
+                std::lock_guard<std::mutex> lock(m_SleepMutex);
+            }
+            m_Wake.notify_all();
+        }
+        return true;
+    }
+    void ThreadPool::WorkerLoop(uint32_t queue)
+    {
+        t_Pool  = this;
+        t_Queue = queue;
+        while (true)
+        {
+            if (TryRun(queue))
+            {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_SleepMutex);
+            m_Wake.wait(lock, [this] { return m_Stop || m_Pending.load(std::memory_order_acquire) != 0; });
+            if (m_Stop)
+            {
+                return;
+            }
+        }
+    }
+    uint32_t ThreadPool::CurrentQueue() const { return (t_Pool == this ? t_Queue : m_Queues.size() - 1); }
+
+}  // namespace ECS
@@ -0,0 +1,13 @@
+#pragma once
+
+namespace ECS
+{
+
+    template <typename Family> template <typename T> uint32_t TypeId<Family>::Get()
+    {
+        static const uint32_t id = s_Next++;
+        return id;
+    }
+    template <typename Family> uint32_t TypeId<Family>::Count() { return s_Next; }
+
+}  // namespace ECS
@@ -1,9 +1,17 @@
 #include <iostream>
 #include <memory>
+#include <atomic>
+#include <filesystem>
 #include "ECS/ECS.h"
 
 using namespace ECS;
 
+// Files the tests write go to the temp directory, tagged with the pid so Test and TestProfile may run side by side.
+std::string TempPath(const std::string& name)
+{
+    return (std::filesystem::temp_directory_path() / ("ecs_" + std::to_string(getpid()) + "_" + name)).string();
+}
+
 struct Vec2
 {
     double v[2];
@@ -16,6 +24,40 @@ struct Vec4
 {
     double v[4];
 };
+struct Label
+{
+    std::string text;
+};
+struct Enemy
+{
+};
+struct Selected
+{
+};
+template <int I> struct Flag
+{
+};
+struct Gravity
+{
+    double g;
+};
+struct Counted
+{
+    static inline int copies = 0;
+
+    Counted(int value = 0) : value(value) {}
+    Counted(const Counted& other) : value(other.value) { ++copies; }
+    Counted(Counted&&)            = default;
+    Counted& operator=(const Counted& other)
+    {
+        value = other.value;
+        ++copies;
+        return *this;
+    }
+    Counted& operator=(Counted&&) = default;
+
+    int value;
+};
 
 double array[20];
 
@@ -34,6 +76,116 @@ public:
     }
 };
 
+std::atomic<int> order;
+int              moved, counted, spun;
+
+class MoveSystem : public System
+{
+public:
+    MoveSystem()
+    {
+        Reads<Vec3>();
+        Writes<Vec2>();
+    }
+    virtual std::string GetName() const override { return "MoveSystem"; }
+    virtual void        Update(float dt) override
+    {
+        View<Vec2, const Vec3>().Each([dt](Vec2& position, const Vec3& velocity) { position.v[0] += velocity.v[0] * dt; });
+        moved = order++;
+    }
+};
+class CountSystem : public System
+{
+public:
+    CountSystem() { Reads<Vec2>(); }
+    virtual std::string GetName() const override { return "CountSystem"; }
+    virtual void        Update(float dt) override
+    {
+        double sum = 0;
+        View<const Vec2>().Each([&sum](const Vec2& position) { sum += position.v[0]; });
+        printf("Count: %.0f\n", sum);
+        counted = order++;
+    }
+};
+class SpinSystem : public System
+{
+public:
+    SpinSystem() { Writes<Vec4>(); }
+    virtual std::string GetName() const override { return "SpinSystem"; }
+    virtual void        Update(float dt) override
+    {
+        View<Vec4>().Each([](Vec4& rotation) { rotation.v[0] += 1; });
+        spun = order++;
+    }
+};
+
+class SpawnSystem : public System
+{
+public:
+    SpawnSystem() { Reads<Vec2>(); }
+    virtual std::string GetName() const override { return "SpawnSystem"; }
+    virtual void        Update(float dt) override
+    {
+        View<const Vec2>().ParallelEach(
+            [this](Entity e, const Vec2& position)
+            {
+                CommandBuffer& commands = Commands();
+                if (position.v[0] < 0)
+                {
+                    commands.Destroy(e);
+                    return;
+                }
+                Entity child = commands.Create();
+                commands.Add<Vec2>(child, {-1, 0});
+                commands.Add<Vec3>(e);
+                commands.Remove<Vec2>(e);
+            },
+            64);
+    }
+};
+
+class ReplicateSystem : public System
+{
+public:
+    ReplicateSystem() { Reads<Vec2, Vec3>(); }
+    virtual std::string GetName() const override { return "ReplicateSystem"; }
+    virtual void        Update(float dt) override
+    {
+        size_t changed = 0, added = 0;
+        View<const Vec2>().Changed<Vec2>().Each([&changed](const Vec2&) { ++changed; });
+        View<const Vec3>().Added<Vec3>().Each([&added](const Vec3&) { ++added; });
+        printf("%zu/%zu ", changed, added);
+    }
+};
+class InspectSystem : public System
+{
+public:
+    InspectSystem() { Reads<Vec2>(); }
+    virtual std::string GetName() const override { return "InspectSystem"; }
+    virtual void        Update(float dt) override
+    {
+        double sum = 0;
+        for (auto [e, v] : View<const Vec2>())
+        {
+            sum += v.v[0] + e.Get<const Vec2>()->v[1];
+        }
+        View<const Vec2>().Each([&sum](const Vec2& v) { sum += v.v[0]; });
+    }
+};
+
+class GravitySystem : public System
+{
+public:
+    GravitySystem() { Reads<Gravity, Enemy>(); }
+    virtual std::string GetName() const override { return "GravitySystem"; }
+    virtual void        Update(float dt) override
+    {
+        size_t enemies = 0;
+        View<Enemy>().Each([&enemies](Enemy&) { ++enemies; });
+        printf("Gravity: %g %zu\n", GetResource<Gravity>()->g, enemies);
+    }
+};
+
 void Print(const std::vector<Entity>& v) { std::cout << v.size() << std::endl; }
 
 template <typename... Components> void Print(Storage& storage)
@@ -85,8 +237,870 @@ void Test1()
     printf("Succeeded!\n");
 }
 
+void Test2(StorageMode mode)
+{
+    Storage             storage(mode);
+    std::vector<Entity> entities;
+    for (int i = 0; i < 1000; ++i)
+    {
+        Entity e = storage.CreateEntity();
+        e.Add<std::string>(std::to_string(i));
+        e.Add<Vec2>({(double)i, 0});
+        if (i % 2 == 0)
+        {
+            e.Add<Vec3>({(double)i, 0, 0});
+        }
+        entities.push_back(e);
+    }
+    for (int i = 0; i < 1000; i += 3)
+    {
+        entities[i].Remove<Vec2>();
+    }
+    for (int i = 0; i < 1000; i += 5)
+    {
+        entities[i].Destroy();
+    }
+
+    size_t total = 0, both = 0, mismatched = 0;
+    for (Entity e : storage.View<std::string, Vec2>())
+    {
+        ++total;
+        both += e.Has<Vec3>();
+        mismatched += (std::stoi(*e.Get<std::string>()) != (int)e.Get<Vec2>()->v[0]);
+    }
+    printf("Churn: %zu %zu %zu\n", total, both, mismatched);
+    Print<std::string, Vec4>(storage);
+
+    printf("Succeeded!\n");
+}
+
+void Test3(StorageMode mode)
+{
+    Storage storage(mode);
+    for (int i = 0; i < 100; ++i)
+    {
+        Entity e = storage.CreateEntity();
+        e.Add<Vec2>({(double)i, 1});
+        if (i % 4 == 0)
+        {
+            e.Add<Vec3>({0, 0, 0});
+        }
+        if (i % 10 == 0)
+        {
+            e.Add<std::string>(std::to_string(i));
+        }
+    }
+
+    storage.View<Vec2, Vec3>().Each([](Vec2& position, Vec3& velocity) { velocity.v[0] = position.v[0] * 2; });
+    double sum = 0;
+    for (auto [e, position, velocity] : storage.View<Vec2, Vec3>())
+    {
+        sum += velocity.v[0] - position.v[0];
+    }
+    size_t names = 0;
+    storage.View<std::string, Vec3>().Each([&names](Entity e, std::string& name, Vec3&) { names += (*e.Get<std::string>() == name); });
+    printf("Each: %.0f %zu\n", sum, names);
+
+    printf("Succeeded!\n");
+}
+
+void Test4()
+{
+    Storage             storage;
+    std::vector<Entity> entities;
+    for (int i = 0; i < 100; ++i)
+    {
+        Entity e = storage.CreateEntity();
+        e.Add<Vec2>();
+        if (i % 2 == 0)
+        {
+            e.Add<Vec3>();
+        }
+        entities.push_back(e);
+    }
+    storage.View<Vec2, Vec3>();
+    const Query& query = storage.CacheQuery<Vec2, Vec3>();
+    for (int i = 0; i < 100; i += 4)
+    {
+        entities[i].Remove<Vec3>();
+    }
+    entities[2].Destroy();
+    entities[1].Add<Vec3>();
+
+    size_t count = 0;
+    storage.View<Vec3, Vec2>().Each([&count](Entity e, Vec3&, Vec2&) { count += e.Has<Vec2>() && e.Has<Vec3>(); });
+    printf("Query: %zu %u %llu %llu\n", count, query.Size(), (unsigned long long)query.Statistics().Hits,
+           (unsigned long long)query.Statistics().Erases);
+#ifdef ECS_PROFILE
+    printf("Query misses: %llu\n", (unsigned long long)storage.QueryMisses<Vec2, Vec3>());
+#endif
+
+    printf("Succeeded!\n");
+}
+
+void Test5(ExecutionMode mode)
+{
+    Storage storage;
+    for (int i = 0; i < 1000; ++i)
+    {
+        Entity e = storage.CreateEntity();
+        e.Add<Vec2>({0, 0});
+        e.Add<Vec3>({1, 0, 0});
+        e.Add<Vec4>();
+    }
+    storage.RegisterSystem<CountSystem>();
+    storage.RegisterSystem<MoveSystem>();
+    storage.RegisterSystem<SpinSystem>();
+    storage.AddSystemDependency<MoveSystem, CountSystem>();
+    storage.AddSystemDependency<SpinSystem, MoveSystem>();
+    bool cycle = storage.AddSystemDependency<CountSystem, SpinSystem>();
+    printf("Cycle: %d\n", cycle);
+    storage.SetExecutionMode(mode);
+    for (int i = 0; i < 3; ++i)
+    {
+        order = 0;
+        storage.UpdateSystems(1);
+        printf("Order: %d %d\n", spun < moved, moved < counted);
+    }
+
+    printf("Succeeded!\n");
+}
+
+void Test6(StorageMode mode)
+{
+    Storage storage(mode);
+    for (int i = 0; i < 100000; ++i)
+    {
+        Entity e = storage.CreateEntity();
+        e.Add<Vec2>({0, 0});
+        if (i % 3 != 0)
+        {
+            e.Add<Vec3>({(double)(i % 7), 0, 0});
+        }
+    }
+    storage.View<Vec2, Vec3>().ParallelEach([](Vec2& position, const Vec3& velocity) { position.v[0] += velocity.v[0]; }, 512);
+    std::atomic<int> visited = 0;
+    storage.View<Vec2>().ParallelEach([&visited](Entity, Vec2&) { ++visited; });
+    double sum = 0;
+    storage.View<Vec2>().Each([&sum](Vec2& position) { sum += position.v[0]; });
+    printf("Parallel: %.0f %d\n", sum, visited.load());
+
+    printf("Succeeded!\n");
+}
+
+void Test7()
+{
+    Storage storage;
+    for (int i = 0; i < 1000; ++i)
+    {
+        storage.CreateEntity().Add<Vec2>({1, 0});
+    }
+    storage.RegisterSystem<SpawnSystem>();
+    storage.SetExecutionMode(ExecutionMode::Parallel);
+    size_t counts[4];
+    for (int frame = 0; frame < 2; ++frame)
+    {
+        storage.UpdateSystems(1);
+        counts[frame * 2]     = 0;
+        counts[frame * 2 + 1] = 0;
+        storage.View<Vec2>().Each([&](Vec2&) { ++counts[frame * 2]; });
+        storage.View<Vec3>().Each([&](Vec3&) { ++counts[frame * 2 + 1]; });
+    }
+    Entity e = storage.CreateEntity();
+    storage.Commands().Add<Vec4>(e);
+    storage.Commands().Remove<Vec4>(e);
+    storage.FlushCommands();
+    printf("Commands: %zu %zu %zu %zu %d\n", counts[0], counts[1], counts[2], counts[3], e.Has<Vec4>());
+}
+
+void Test8(StorageMode mode)
+{
+    Storage storage(mode);
+    for (int i = 0; i < 100; ++i)
+    {
+        storage.CreateEntity().Destroy();
+    }
+    std::vector<Entity> entities = storage.CreateEntities(1000, Vec2{1, 2}, Vec3{0, 0, 3});
+    entities[10].Destroy();
+    std::vector<Vec4> values(entities.size(), Vec4{0, 0, 0, 1});
+    storage.Insert<Vec4>(entities.begin(), entities.end(), values.begin());
+    float sum = 0;
+    storage.View<Vec2, Vec3, Vec4>().Each([&](Vec2& a, Vec3& b, Vec4& c) { sum += a.v[1] + b.v[2] + c.v[3]; });
+    printf("Bulk: %zu %g %d\n", entities.size(), sum, entities[999].Has<Vec4>());
+}
+
+void Test9()
+{
+    Storage             storage;
+    std::vector<Entity> entities = storage.CreateEntities(100000, Vec2{});
+    for (size_t i = 0; i < entities.size(); ++i)
+    {
+        if (i % 1000 != 7)
+        {
+            entities[i].Destroy();
+        }
+    }
+    size_t live = 0;
+    for (Entity e : storage.View<>())
+    {
+        live += e.Valid();
+    }
+    // A stale handle must not come back to life however often its slot is reused.
+    Entity first = storage.CreateEntity();
+    Entity last  = first;
+    size_t stale = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        last.Destroy();
+        last = storage.CreateEntity();
+        stale += first.Valid();
+    }
+    printf("Entities: %zu %zu %d\n", live, stale, last.Valid());
+}
+
+void Test10()
+{
+#ifdef ECS_PROFILE
+    Storage storage;
+    storage.CreateEntities(1000, Vec2{1, 0});
+    storage.RegisterSystem<SpawnSystem>();
+    storage.SetExecutionMode(ExecutionMode::Parallel);
+    storage.UpdateSystems(1);
+    storage.UpdateSystems(1);
+    std::vector<Profiler::Statistics> stats = storage.GetProfiler().Stats();
+    const std::string                 trace = TempPath("profile_trace.json");
+    printf("Profile: %s %llu %g %g %d %d\n", stats[0].Name.c_str(), (unsigned long long)stats[0].Updates, stats[0].Visited, stats[0].Changes,
+           stats[0].Min <= stats[0].P99, storage.GetProfiler().WriteTrace(trace));
+    std::remove(trace.c_str());
+#endif
+}
+
+void Test11(StorageMode mode)
+{
+    PageArena arena(1 << 16);
+    size_t    peak = 0;
+    {
+        Storage             storage(mode, &arena);
+        std::vector<Entity> entities = storage.CreateEntities(5000, Vec2{1, 0});
+        for (size_t i = 0; i < entities.size(); i += 2)
+        {
+            entities[i].Add<Vec3>();
+            entities[i + 1].Destroy();
+        }
+        storage.CacheQuery<Vec2, Vec3>();
+        size_t count = 0;
+        storage.View<Vec2, Vec3>().Each([&count](Vec2&, Vec3&) { ++count; });
+        peak = arena.Allocated();
+        printf("Arena: %zu %d %d ", count, peak > 5000 * sizeof(Vec2), arena.Release());
+    }
+    printf("%zu %d\n", arena.Allocated(), arena.Release());
+}
+
+void Test12(StorageMode mode)
+{
+    Storage             storage(mode);
+    std::vector<Entity> entities = storage.CreateEntities(100, Vec2{});
+    storage.RegisterSystem<ReplicateSystem>();
+    // Reading through const views and Get<const T> leaves the Changed ticks alone, so the second update reports nothing.
+    storage.RegisterSystem<InspectSystem>();
+    printf("Changes: ");
+    storage.UpdateSystems(1);
+    storage.UpdateSystems(1);
+    for (int i = 0; i < 5; ++i)
+    {
+        entities[i * 10].Patch<Vec2>([](Vec2& v) { v.v[0] = 1; });
+    }
+    entities[1].Get<Vec2>();
+    entities[4].Get<const Vec2>();
+    entities[6].MarkChanged<Vec2>();
+    entities[2].Add<Vec3>();
+    entities[3].Add<Vec3>();
+    // A mutable view element counts as a write for every entity it visits.
+    storage.View<Vec2, const Vec3>().Each([](Vec2& v, const Vec3&) { v.v[1] = 1; });
+    storage.UpdateSystems(1);
+    entities[2].Add<Vec3>();
+    storage.UpdateSystems(1);
+    printf("\n");
+}
+
+void RegisterSnapshots(Storage& storage)
+{
+    storage.RegisterSnapshot<Vec2>("Vec2");
+    storage.RegisterSnapshot<Vec3>("Vec3");
+    storage.RegisterSnapshot<Label>("Label", {[](const Label& label, SnapshotWriter& writer)
+                                              {
+                                                  writer.Write(uint32_t(label.text.size()));
+                                                  writer.Write(label.text.data(), label.text.size());
+                                              },
+                                              [](SnapshotReader& reader)
+                                              {
+                                                  uint32_t    size = reader.Read<uint32_t>();
+                                                  const char* text = reinterpret_cast<const char*>(reader.Read(size));
+                                                  return Label{text ? std::string(text, size) : std::string()};
+                                              }});
+}
+
+void Test13(StorageMode save, StorageMode load)
+{
+    const std::string path    = TempPath("snapshot.bin");
+    const std::string corrupt = TempPath("snapshot_corrupt.bin");
+    uint32_t          tick;
+    {
+        Storage storage(save);
+        RegisterSnapshots(storage);
+        std::vector<Entity> entities = storage.CreateEntities(3000, Vec2{1, 2});
+        for (size_t i = 0; i < entities.size(); ++i)
+        {
+            if (i % 3 == 0)
+            {
+                entities[i].Destroy();
+            }
+            else if (i % 3 == 1)
+            {
+                entities[i].Add<Vec3>(Vec3{0, 0, double(i)});
+                entities[i].Add<Label>(Label{"entity " + std::to_string(i)});
+            }
+        }
+        tick = storage.AdvanceTick();
+        entities[2].Patch<Vec2>([](Vec2& v) { v.v[0] = 5; });
+        storage.SaveSnapshot(path);
+    }
+    Storage storage(load);
+    RegisterSnapshots(storage);
+    storage.CacheQuery<Vec2, Vec3>();
+    bool   loaded = storage.LoadSnapshot(path);
+    double sum    = 0;
+    size_t labels = 0;
+    storage.View<Vec2, Vec3>().Each([&sum](Vec2& a, Vec3& b) { sum += a.v[1] + b.v[2]; });
+    storage.View<Vec3, Label>().Each([&labels](Vec3& b, Label& l) { labels += (l.text == "entity " + std::to_string(int(b.v[2]))); });
+    size_t changed = 0;
+    for (auto e : storage.View<Vec2>().Since(tick).Changed<Vec2>())
+    {
+        changed += e.Get<Vec2>()->v[0] == 5;
+    }
+    size_t live = 0;
+    for (Entity e : storage.View<Vec2>())
+    {
+        live += e.Valid();
+    }
+
+    // A page index or dense id pointing past the saved entities is refused before anything is restored.
+    std::ifstream  file(path, std::ios::binary);
+    std::string    bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    SnapshotReader reader(reinterpret_cast<const std::byte*>(bytes.data()), bytes.size());
+    SnapshotHeader header = reader.Read<SnapshotHeader>();
+    reader.ReadArray<uint32_t>(header.Entities);
+    reader.ReadArray<uint32_t>(header.Entities);
+    reader.ReadArray<uint64_t>((header.Entities + 63) / 64);
+    reader.Read<uint32_t>();
+    SnapshotColumn column;
+    reader.ReadColumn(column);
+    size_t rejected = 0;
+    for (const uint32_t* field : {column.PageIndices, column.Entities})
+    {
+        std::string    edited = bytes;
+        const uint32_t value  = 1u << 30;
+        std::memcpy(edited.data() + (reinterpret_cast<const char*>(field) - bytes.data()), &value, sizeof(value));
+        std::ofstream(corrupt, std::ios::binary).write(edited.data(), edited.size());
+        Storage target(load);
+        RegisterSnapshots(target);
+        rejected += !target.LoadSnapshot(corrupt) && target.View<Vec2>().Empty();
+    }
+    // So is a serialized column whose stream is shorter than its components need.
+    while (reader.Good() && column.Name != "Label")
+    {
+        reader.ReadColumn(column);
+    }
+    {
+        std::string    edited = bytes;
+        const uint64_t length = column.Bytes - 1;
+        std::memcpy(edited.data() + (reinterpret_cast<const char*>(column.Data) - bytes.data()) - sizeof(length), &length, sizeof(length));
+        std::ofstream(corrupt, std::ios::binary).write(edited.data(), edited.size());
+        Storage target(load);
+        RegisterSnapshots(target);
+        rejected += !target.LoadSnapshot(corrupt) && target.View<Label>().Empty() && target.View<Vec2>().Empty();
+    }
+    printf("Snapshot: %d %zu %g %zu %zu %d %zu\n", loaded, live, sum, labels, changed, storage.LoadSnapshot(path), rejected);
+    std::remove(path.c_str());
+    std::remove(corrupt.c_str());
+}
+
+void Test14(StorageMode mode)
+{
+    Storage             storage(mode);
+    std::vector<Entity> nodes = storage.CreateEntities(1000, Vec2{1, 0});
+    // Children are created before their parents, so creation order is the opposite of depth order.
+    for (size_t i = 0; i + 1 < nodes.size(); ++i)
+    {
+        nodes[i].SetParent(nodes[(i + nodes.size()) / 2]);
+    }
+    bool   cycle    = nodes[999].SetParent(nodes[0]);
+    size_t children = 0;
+    for (Entity child = nodes[999].FirstChild(); child.Valid(); child = child.NextSibling())
+    {
+        children += (child.Parent() == nodes[999]);
+    }
+    storage.SortHierarchy<Vec2>();
+    size_t ordered = 0;
+    storage.View<Hierarchy, Vec2>().Each(
+        [&ordered](Entity e, Hierarchy& node, Vec2& v)
+        {
+            Entity parent = e.Parent();
+            ordered += !parent.Valid() || parent.Get<Vec2>()->v[1] == node.Depth - 1;
+            v.v[1]    = node.Depth;
+        });
+    nodes[998].Destroy();
+    printf("Hierarchy: %d %zu %zu %d %d\n", cycle, children, ordered, nodes[997].Parent().Valid(), nodes[995].Parent() == nodes[997]);
+}
+
+void Test15(StorageMode mode)
+{
+    Storage             storage(mode);
+    std::vector<Entity> entities = storage.CreateEntities(1000, Vec2{1, 0});
+    const OwningGroup*  group    = storage.Group<Vec2, Vec3>();
+    for (size_t i = 0; i < entities.size(); i += 3)
+    {
+        // The returned pointer has to follow the component into the group region.
+        entities[i].Add<Vec3>()->v[0] = double(i);
+    }
+    for (size_t i = 0; i + 3 < entities.size(); i += 9)
+    {
+        entities[i].Remove<Vec3>();
+        entities[i + 3].Destroy();
+    }
+    storage.CreateEntities(100, Vec2{1, 0}, Vec3{1, 0, 0});
+    size_t matching = 0;
+    double sum      = 0;
+    storage.View<Vec2, Vec3>().Each(
+        [&](Entity e, Vec2& a, Vec3& b)
+        {
+            matching += (e.Get<Vec3>() == &b && e.Get<Vec2>() == &a);
+            sum += b.v[0];
+        });
+    size_t iterated = 0;
+    for (auto [e, b] : storage.View<Vec3>())
+    {
+        iterated += (e.Has<Vec2>() && b.v[0] != 0);
+    }
+    printf("Group: %u %zu %g %zu %d\n", (group ? group->Size() : 0), matching, sum, iterated, storage.Group<Vec3, Vec4>() == nullptr);
+}
+
+void Test16(StorageMode mode)
+{
+    Storage             storage(mode);
+    std::vector<Entity> entities = storage.CreateEntities(1000, Vec2{}, Vec3{});
+    for (size_t i = 0; i < entities.size(); ++i)
+    {
+        double key = double(i * 7919 % 1000);
+        entities[i].Get<Vec2>()->v[0] = key;
+        entities[i].Get<Vec3>()->v[0] = key;
+        if (i % 4 == 0)
+        {
+            entities[i].Add<Vec4>();
+        }
+    }
+    storage.Group<Vec2, Vec4>();
+    storage.Sort<Vec2>([](const Vec2& a, const Vec2& b) { return a.v[0] < b.v[0]; });
+    storage.Sort<Vec2, Vec3>();
+    // Counts the entities visited in ascending key order, and those whose components still belong to them.
+    auto ordered = [&storage](auto view)
+    {
+        double last   = -1;
+        size_t sorted = 0;
+        size_t owned  = 0;
+        for (auto [e, a] : view)
+        {
+            sorted += (a.v[0] >= last);
+            owned += (e.template Get<Vec2>()->v[0] == e.template Get<Vec3>()->v[0]);
+            last = a.v[0];
+        }
+        return std::make_pair(sorted, owned);
+    };
+    auto [sorted2, owned2] = ordered(storage.View<Vec2>());
+    auto [sorted3, owned3] = ordered(storage.View<Vec3>());
+    size_t grouped = 0;
+    double last    = -1;
+    storage.View<Vec2, Vec4>().Each(
+        [&](Vec2& a, Vec4&)
+        {
+            grouped += (a.v[0] >= last);
+            last = a.v[0];
+        });
+    printf("Sort: %zu %zu %zu %zu %zu\n", sorted2, owned2, sorted3, owned3, grouped);
+}
+
+void Test17(StorageMode mode)
+{
+    Storage storage(mode);
+    Entity  a = storage.CreateEntity();
+    Entity  b = storage.CreateEntity();
+    Counted::copies = 0;
+    a.Add(Counted(1));
+    b.Emplace<Counted>(2);
+    b.Emplace<Counted>(3);
+    a.Replace<Counted>(4);
+    bool missing = (a.Replace<Vec2>() == nullptr);
+    int  copies  = Counted::copies;
+    a.Add<std::unique_ptr<int>>(std::make_unique<int>(5));
+    b.Emplace<std::unique_ptr<int>>(new int(6));
+    b.Replace<std::unique_ptr<int>>(std::make_unique<int>(7));
+    storage.Commands().Add(a, std::make_unique<int>(8));
+    storage.FlushCommands();
+    printf("Emplace: %d %d %d %d %d %d\n", copies, missing, a.Get<Counted>()->value, b.Get<Counted>()->value, **a.Get<std::unique_ptr<int>>(),
+           **b.Get<std::unique_ptr<int>>());
+}
+
+void Test18(StorageMode mode)
+{
+    Storage             storage(mode);
+    std::vector<Entity> entities = storage.CreateEntities(100, Vec2{});
+    for (size_t i = 0; i < entities.size(); ++i)
+    {
+        if (i % 2 == 0)
+        {
+            entities[i].Add<Vec3>();
+        }
+        if (i % 3 == 0)
+        {
+            entities[i].Add<Vec4>();
+        }
+        if (i % 10 == 0)
+        {
+            entities[i + 1].SetParent(entities[i]);
+        }
+    }
+    storage.Group<Vec2, Vec3>();
+    storage.CacheQuery<Vec2, Vec4>();
+    uint32_t removed   = storage.RemoveAll<Vec4>();
+    size_t   remaining = 0;
+    for (Entity e : storage.View<Vec2, Vec4>())
+    {
+        remaining += e.Valid();
+    }
+    uint32_t destroyed = storage.DestroyAll<Vec3>();
+    size_t   alive     = 0, roots = 0;
+    for (const Entity& e : entities)
+    {
+        alive += e.Valid();
+        roots += (e.Valid() && e.Parent() == Entity() && e.Has<Vec2>() && !e.Has<Vec3>());
+    }
+    size_t grouped = 0;
+    storage.View<Vec2, Vec3>().Each([&grouped](Vec2&, Vec3&) { ++grouped; });
+    printf("Batch: %u %zu %u %zu %zu %zu\n", removed, remaining, destroyed, alive, roots, grouped);
+}
+
+void Test19(StorageMode mode)
+{
+    Storage storage(mode);
+    storage.RegisterSnapshot<Vec2>("Vec2");
+    storage.RegisterSnapshot<Enemy>("Enemy");
+    std::vector<Entity> enemies  = storage.CreateEntities(10, Vec2{}, Enemy{});
+    std::vector<Entity> entities = storage.CreateEntities(10, Vec2{});
+    for (size_t i = 0; i < entities.size(); i += 2)
+    {
+        entities[i].Add<Selected>();
+        enemies[i].Add<Selected>();
+    }
+    storage.Commands().Add<Enemy>(entities[1]);
+    storage.FlushCommands();
+    enemies[9].Remove<Enemy>();
+    size_t tagged = 0, selected = 0, zipped = 0;
+    for (auto [e, enemy] : storage.View<Enemy>())
+    {
+        tagged += (&enemy == e.Get<Enemy>());
+    }
+    storage.View<Selected, Enemy>().Each([&selected](Selected&, Enemy&) { ++selected; });
+    storage.View<Vec2, Enemy>().Each([&zipped](Entity e, Vec2& v, Enemy&) { zipped += (&v == e.Get<Vec2>()); });
+    storage.CacheQuery<Selected>();
+    size_t cached = 0;
+    storage.View<Selected>().Each([&cached](Selected&) { ++cached; });
+    const std::string path  = TempPath("tags.bin");
+    bool              saved = storage.SaveSnapshot(path);
+    printf("Tags: %zu %zu %zu %zu %d %d %d\n", tagged, selected, zipped, cached, enemies[9].Has<Enemy>(), entities[1].Get<Enemy>() != nullptr,
+           entities[2].Get<Enemy>() != nullptr);
+
+    Storage loaded(mode);
+    loaded.RegisterSnapshot<Vec2>("Vec2");
+    loaded.RegisterSnapshot<Enemy>("Enemy");
+    bool   restored = loaded.LoadSnapshot(path);
+    size_t reloaded = 0;
+    loaded.View<Vec2, Enemy>().Each([&reloaded](Vec2&, Enemy&) { ++reloaded; });
+    std::remove(path.c_str());
+    uint32_t unselected = storage.RemoveAll<Selected>();
+    uint32_t destroyed  = storage.DestroyAll<Enemy>();
+    printf("Tags: %d %d %zu %u %u %d\n", saved, restored, reloaded, unselected, destroyed, storage.View<Vec2>().Empty());
+
+    storage.SetResource<Gravity>(Gravity{9.8});
+    storage.RegisterSystem<GravitySystem>();
+    storage.CreateEntities(3, Enemy{});
+    storage.UpdateSystems(1);
+    storage.RemoveResource<Gravity>();
+    printf("Resource: %d %d\n", storage.GetResource<Gravity>() == nullptr, storage.GetResource<Vec2>() == nullptr);
+}
+
+// Component ids past 64 and entity ids across several matrix blocks.
+template <int... I> void Test20(StorageMode mode, std::integer_sequence<int, I...>)
+{
+    Storage storage(mode);
+    storage.CreateEntity().Add<Flag<0>>();
+    (storage.CreateEntity().Add<Flag<I>>(), ...);
+    std::vector<Entity> entities = storage.CreateEntities(1000, Vec2{});
+    size_t              expected = 0;
+    for (size_t i = 0; i < entities.size(); ++i)
+    {
+        if (i % 3 == 0)
+        {
+            entities[i].Add<Flag<69>>();
+        }
+        if (i % 5 == 0)
+        {
+            entities[i].Add<Flag<40>>();
+        }
+        if (i % 7 == 0)
+        {
+            entities[i].Remove<Flag<69>>();
+        }
+        expected += (i % 3 == 0 && i % 5 == 0 && i % 7 != 0);
+    }
+    size_t iterated = 0, each = 0;
+    for (auto [e, a, b] : storage.View<Flag<69>, Flag<40>>())
+    {
+        iterated += (e.template Has<Flag<69>>() && e.template Has<Flag<40>>());
+    }
+    storage.View<Flag<40>, Flag<69>>().Each([&each](Flag<40>&, Flag<69>&) { ++each; });
+    std::atomic<size_t> parallel = 0;
+    storage.View<Flag<69>, Flag<40>>().ParallelEach([&parallel](Flag<69>&, Flag<40>&) { ++parallel; }, 100);
+    uint32_t destroyed = storage.DestroyAll<Flag<40>, Flag<69>>();
+    printf("Matrix: %zu %zu %zu %zu %u %d\n", expected, iterated, each, parallel.load(), destroyed, storage.View<Flag<69>, Flag<40>>().Empty());
+}
+
+void Test21(StorageMode mode)
+{
+    Storage             storage(mode);
+    std::vector<Entity> entities = storage.CreateEntities(100, Vec2{}, Vec3{});
+    for (size_t i = 0; i < entities.size(); ++i)
+    {
+        if (i % 2 == 0)
+        {
+            entities[i].Add(Gravity{double(i)});
+        }
+        if (i % 3 == 0)
+        {
+            entities[i].Add<Enemy>();
+        }
+        if (i % 5 == 0)
+        {
+            entities[i].Add(Vec4{});
+        }
+    }
+    size_t visited = 0, found = 0;
+    double sum     = 0;
+    for (auto [e, a, g] : storage.View<Vec2, Optional<Gravity>>().Exclude<Enemy>())
+    {
+        visited += !e.Has<Enemy>();
+        found += (g != nullptr);
+        sum += (g ? g->g : 0);
+    }
+    printf("Exclude: %zu %zu %g", visited, found, sum);
+
+    visited = found = 0;
+    storage.View<Optional<Gravity>, Vec3>().Exclude<Enemy, Vec4>().Each([&](Gravity* g, Vec3&) { ++visited, found += (g != nullptr); });
+    printf(" %zu %zu", visited, found);
+    visited = found = 0;
+    storage.View<Enemy, Optional<Gravity>>().Exclude<Vec4>().Each([&](Enemy&, Gravity* g) { ++visited, found += (g != nullptr); });
+    printf(" %zu %zu", visited, found);
+    visited = found = 0;
+    storage.View<Optional<Vec4>>().Each([&](Entity e, Vec4* v) { ++visited, found += (v != nullptr) == e.Has<Vec4>(); });
+    printf(" %zu %zu\n", visited, found);
+
+    // Group and cached query driven views look optional components up per entity.
+    storage.Group<Vec2, Vec3>();
+    storage.CacheQuery<Vec2, Gravity>();
+    std::atomic<size_t> parallel = 0, optional = 0;
+    storage.View<Vec2, Vec3, Optional<Gravity>>().Exclude<Enemy>().ParallelEach([&](Vec2&, Vec3&, Gravity* g) { ++parallel, optional += (g != nullptr); }, 16);
+    visited = found = 0;
+    storage.View<Vec2, Gravity, Optional<Vec4>>().Exclude<Enemy>().Each([&](Vec2&, Gravity&, Vec4* v) { ++visited, found += (v != nullptr); });
+    printf("Optional: %zu %zu %zu %zu\n", parallel.load(), optional.load(), visited, found);
+}
+
+// A reader thread checks that every frame it takes holds one consistent tick while the simulation keeps writing.
+void Test22(StorageMode mode)
+{
+    Storage             storage(mode);
+    std::vector<Entity> entities = storage.CreateEntities(3000, Vec2{}, Vec3{});
+    for (size_t i = 0; i < entities.size(); i += 3)
+    {
+        entities[i].Add<Enemy>();
+        entities[i].Add(Label{"enemy"});
+    }
+    FrameBuffer<Vec2, Enemy, Label> frames(storage);
+    printf("Frames: %d", frames.Acquire() == nullptr);
+    frames.Publish();
+    std::shared_ptr<Storage> first = frames.Acquire();
+
+    std::atomic<bool> done = false;
+    std::atomic<int>  torn = 0, seen = 0;
+    std::thread       reader(
+        [&]
+        {
+            while (!done)
+            {
+                std::shared_ptr<Storage> frame = frames.Acquire();
+                double                   tick  = -1;
+                frame->View<const Vec2>().Each(
+                    [&](const Vec2& v)
+                    {
+                        torn += (tick >= 0 && v.v[0] != tick);
+                        tick = v.v[0];
+                    });
+                ++seen;
+            }
+        });
+    for (int tick = 1; tick <= 200; ++tick)
+    {
+        storage.View<Vec2>().Each([tick](Vec2& v) { v.v[0] = tick; });
+        frames.Publish();
+    }
+    done = true;
+    reader.join();
+
+    entities[0].Destroy();
+    entities[1].Remove<Vec2>();
+    frames.Publish();
+    std::shared_ptr<Storage> last = frames.Acquire();
+    size_t                   count = 0, enemies = 0, labels = 0;
+    for (auto [e, v] : last->View<const Vec2>())
+    {
+        count += (v.v[0] == 200);
+        enemies += e.Has<Enemy>();
+        labels += (e.Has<Enemy>() && e.Get<const Label>()->text == "enemy");
+    }
+    printf(" %d %d %zu %zu %zu %d", torn.load(), seen.load() > 0, count, enemies, labels, !last->View<Vec3>().Empty());
+    double old = 0;
+    first->View<const Vec2>().Each([&old](const Vec2& v) { old = std::max(old, v.v[0]); });
+    size_t marked = 0;
+    first->View<Enemy, const Label>().Each([&marked](Enemy&, const Label&) { ++marked; });
+    printf(" %g %zu", old, marked);
+
+    // Once the frames are free again they are reused and only take the values written since each was last published.
+    first.reset();
+    last.reset();
+    for (int tick = 1; tick <= 3; ++tick)
+    {
+        storage.AdvanceTick();
+        entities[2 + tick].Get<Vec2>()->v[0] = -tick;
+        frames.Publish();
+    }
+    double expected = 0, published = 0;
+    storage.View<const Vec2>().Each([&expected](const Vec2& v) { expected += v.v[0]; });
+    frames.Acquire()->View<const Vec2>().Each([&published](const Vec2& v) { published += v.v[0]; });
+    printf(" %d\n", expected == published);
+}
+
+// Observers see events as runs of one kind in the order they happened, once per flush.
+void Test23(StorageMode mode)
+{
+    Storage     storage(mode);
+    std::string log;
+    size_t      stale = 0;
+    auto        record = [&log](char kind) { return [&log, kind](std::span<const Entity> entities) { log += kind + std::to_string(entities.size()) + " "; }; };
+    storage.OnAdd<Vec2>(record('A'));
+    storage.OnRemove<Vec2>(record('R'));
+    storage.OnDestroy<Vec2>(record('D'));
+    storage.OnDestroy<Enemy>(
+        [&stale](std::span<const Entity> entities)
+        {
+            for (const Entity& e : entities)
+            {
+                stale += !e.Valid();
+            }
+        });
+
+    std::vector<Entity> entities = storage.CreateEntities(10, Vec2{}, Vec3{});
+    entities[0].Add(Vec2{});
+    entities[0].Remove<Vec2>();
+    entities[0].Add(Vec2{});
+    entities[1].Add<Vec4>();
+    entities[2].Add<Enemy>();
+    entities[3].Add<Enemy>();
+    storage.DestroyAll<Enemy>();
+    entities[4].Destroy();
+    storage.FlushEvents();
+    log += "| ";
+    storage.FlushEvents();
+
+    Entity e = storage.CreateEntity();
+    storage.Commands().Add<Vec2>(e);
+    storage.Commands().Destroy(entities[5]);
+    storage.Insert<Vec2>(entities.begin() + 6, entities.end(), std::vector<Vec2>(4).begin());
+    storage.UpdateSystems(0);
+    log += "| ";
+    storage.RemoveAll<Vec2>();
+    storage.UpdateSystems(0);
+
+    // Observers registered from inside a callback join after the flush, the first delivery only reaches the original one.
+    size_t joined = 0;
+    storage.OnAdd<Vec4>(
+        [&storage, &joined](std::span<const Entity>)
+        {
+            for (int i = 0; i < 16; ++i)
+            {
+                storage.OnAdd<Vec4>([&joined](std::span<const Entity> entities) { joined += entities.size(); });
+            }
+        });
+    entities[6].Add<Vec4>();
+    storage.FlushEvents();
+    entities[7].Add<Vec4>();
+    storage.FlushEvents();
+    printf("Observers: %s%zu %zu\n", log.c_str(), stale, joined);
+
+    printf("Succeeded!\n");
+}
+
 int main()
 {
     Test1();
+    Test2(StorageMode::Pooled);
+    Test2(StorageMode::Archetype);
+    Test3(StorageMode::Pooled);
+    Test3(StorageMode::Archetype);
+    Test4();
+    Test5(ExecutionMode::Serial);
+    Test5(ExecutionMode::Parallel);
+    Test6(StorageMode::Pooled);
+    Test6(StorageMode::Archetype);
+    Test7();
+    Test8(StorageMode::Pooled);
+    Test8(StorageMode::Archetype);
+    Test9();
+    Test10();
+    Test11(StorageMode::Pooled);
+    Test11(StorageMode::Archetype);
+    Test12(StorageMode::Pooled);
+    Test12(StorageMode::Archetype);
+    Test13(StorageMode::Pooled, StorageMode::Pooled);
+    Test13(StorageMode::Pooled, StorageMode::Archetype);
+    Test13(StorageMode::Archetype, StorageMode::Pooled);
+    Test13(StorageMode::Archetype, StorageMode::Archetype);
+    Test14(StorageMode::Pooled);
+    Test14(StorageMode::Archetype);
+    Test15(StorageMode::Pooled);
+    Test15(StorageMode::Archetype);
+    Test16(StorageMode::Pooled);
+    Test16(StorageMode::Archetype);
+    Test17(StorageMode::Pooled);
+    Test17(StorageMode::Archetype);
+    Test18(StorageMode::Pooled);
+    Test18(StorageMode::Archetype);
+    Test19(StorageMode::Pooled);
+    Test19(StorageMode::Archetype);
+    Test20(StorageMode::Pooled, std::make_integer_sequence<int, 70>());
+    Test20(StorageMode::Archetype, std::make_integer_sequence<int, 70>());
+    Test21(StorageMode::Pooled);
+    Test21(StorageMode::Archetype);
+    Test22(StorageMode::Pooled);
+    Test22(StorageMode::Archetype);
+    Test23(StorageMode::Pooled);
+    Test23(StorageMode::Archetype);
     return 0;
 }
\ No newline at end of file